@@ -73,8 +73,9 @@ CratesMode::CratesMode() {
 		camera = scene.new_camera(transform);
 	}
 	
-	//start the 'loop' sample playing at the large crate:
+	//start the 'loop' sample playing at the large crate (and keep it there):
 	loop = sample_loop->play(large_crate->transform->position, 1.0f, Sound::Loop);
+	scene.new_sound_emitter(large_crate->transform, loop);
 }
 
 CratesMode::~CratesMode() {
@@ -150,10 +151,7 @@ void CratesMode::update(float elapsed) {
 		//camera looks down -z, so right is +x:
 		Sound::listener.set_right( glm::normalize(cam_to_world[0]) );
 
-		if (loop) {
-			glm::mat4 large_crate_to_world = large_crate->transform->make_local_to_world();
-			loop->set_position( large_crate_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
-		}
+		scene.update_sound_emitters();
 	}
 
 	dot_countdown -= elapsed;
@@ -0,0 +1,257 @@
+#include "Crowd.hpp"
+#include "Jobs.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+Crowd::Crowd(WalkMesh const &walk_mesh_) : walk_mesh(walk_mesh_) {
+}
+
+uint32_t Crowd::add_agent(WalkMesh::WalkPoint const &at, float radius, float max_speed) {
+	assert(at.triangle < walk_mesh.triangle_count);
+	triangles.emplace_back(at.triangle);
+	weights.emplace_back(at.weights);
+	positions.emplace_back(walk_mesh.world_point(at));
+	preferred.emplace_back(0.0f);
+	velocities.emplace_back(0.0f);
+	radii.emplace_back(radius);
+	max_speeds.emplace_back(max_speed);
+	return uint32_t(triangles.size() - 1);
+}
+
+uint32_t Crowd::hash_bucket(glm::ivec2 const &cell) const {
+	//(table size is a power of two)
+	return (uint32_t(cell.x) * 73856093U ^ uint32_t(cell.y) * 19349663U) & uint32_t(hash_first.size() - 2);
+}
+
+void Crowd::build_hash() {
+	uint32_t count = uint32_t(positions.size());
+	uint32_t buckets = 1;
+	while (buckets < 2 * count) buckets *= 2;
+	hash_cell = neighbor_distance;
+
+	//counting sort agents into buckets:
+	hash_first.assign(buckets + 1, 0);
+	hash_agents.resize(count);
+	for (uint32_t a = 0; a < count; ++a) {
+		glm::ivec2 cell = glm::ivec2(glm::floor(glm::vec2(positions[a]) / hash_cell));
+		hash_first[hash_bucket(cell) + 1] += 1;
+	}
+	for (uint32_t b = 0; b < buckets; ++b) {
+		hash_first[b + 1] += hash_first[b];
+	}
+	hash_fill.assign(hash_first.begin(), hash_first.end() - 1);
+	for (uint32_t a = 0; a < count; ++a) {
+		glm::ivec2 cell = glm::ivec2(glm::floor(glm::vec2(positions[a]) / hash_cell));
+		hash_agents[hash_fill[hash_bucket(cell)]++] = a;
+	}
+}
+
+//2D cross product:
+static float det(glm::vec2 const &a, glm::vec2 const &b) {
+	return a.x * b.y - a.y * b.x;
+}
+
+//The three linear programs below are those of the RVO2 library (van den Berg et al.):
+// find the velocity within 'radius' that satisfies all the lines and is closest to 'optimal'
+// (or, with 'direction_optimal', furthest along 'optimal').
+
+//solve on line 'line_no', subject to the lines before it:
+static bool linear_program1(std::vector< Crowd::Line > const &lines, uint32_t line_no, float radius, glm::vec2 const &optimal, bool direction_optimal, glm::vec2 *result) {
+	Crowd::Line const &line = lines[line_no];
+	float dot = glm::dot(line.point, line.direction);
+	float discriminant = dot * dot + radius * radius - glm::dot(line.point, line.point);
+	if (discriminant < 0.0f) return false; //max speed circle misses the line
+
+	float root = std::sqrt(discriminant);
+	float t_left = -dot - root;
+	float t_right = -dot + root;
+	for (uint32_t i = 0; i < line_no; ++i) {
+		float denominator = det(line.direction, lines[i].direction);
+		float numerator = det(lines[i].direction, line.point - lines[i].point);
+		if (std::abs(denominator) <= 1e-5f) {
+			//lines are parallel:
+			if (numerator < 0.0f) return false;
+			continue;
+		}
+		float t = numerator / denominator;
+		if (denominator >= 0.0f) t_right = std::min(t_right, t);
+		else t_left = std::max(t_left, t);
+		if (t_left > t_right) return false;
+	}
+
+	if (direction_optimal) {
+		*result = line.point + (glm::dot(optimal, line.direction) > 0.0f ? t_right : t_left) * line.direction;
+	} else {
+		float t = glm::clamp(glm::dot(line.direction, optimal - line.point), t_left, t_right);
+		*result = line.point + t * line.direction;
+	}
+	return true;
+}
+
+//solve subject to all lines; returns the number of lines satisfied before failing:
+static uint32_t linear_program2(std::vector< Crowd::Line > const &lines, float radius, glm::vec2 const &optimal, bool direction_optimal, glm::vec2 *result) {
+	if (direction_optimal) {
+		*result = optimal * radius;
+	} else if (glm::dot(optimal, optimal) > radius * radius) {
+		*result = glm::normalize(optimal) * radius;
+	} else {
+		*result = optimal;
+	}
+	for (uint32_t i = 0; i < lines.size(); ++i) {
+		if (det(lines[i].direction, lines[i].point - *result) > 0.0f) {
+			glm::vec2 before = *result;
+			if (!linear_program1(lines, i, radius, optimal, direction_optimal, result)) {
+				*result = before;
+				return i;
+			}
+		}
+	}
+	return uint32_t(lines.size());
+}
+
+//when the lines can't all be satisfied, find the velocity that violates them least:
+static void linear_program3(std::vector< Crowd::Line > const &lines, uint32_t begin, float radius, std::vector< Crowd::Line > &projected, glm::vec2 *result) {
+	float distance = 0.0f;
+	for (uint32_t i = begin; i < lines.size(); ++i) {
+		if (det(lines[i].direction, lines[i].point - *result) <= distance) continue;
+		projected.clear();
+		for (uint32_t j = 0; j < i; ++j) {
+			Crowd::Line line;
+			float determinant = det(lines[i].direction, lines[j].direction);
+			if (std::abs(determinant) <= 1e-5f) {
+				if (glm::dot(lines[i].direction, lines[j].direction) > 0.0f) continue; //same direction
+				line.point = 0.5f * (lines[i].point + lines[j].point); //opposite directions
+			} else {
+				line.point = lines[i].point + (det(lines[j].direction, lines[i].point - lines[j].point) / determinant) * lines[i].direction;
+			}
+			line.direction = glm::normalize(lines[j].direction - lines[i].direction);
+			projected.emplace_back(line);
+		}
+		glm::vec2 before = *result;
+		if (linear_program2(projected, radius, glm::vec2(-lines[i].direction.y, lines[i].direction.x), true, result) < projected.size()) {
+			//(only fails through rounding; the result is already as good as it gets)
+			*result = before;
+		}
+		distance = det(lines[i].direction, lines[i].point - *result);
+	}
+}
+
+glm::vec2 Crowd::avoid(uint32_t a, float elapsed, Scratch &scratch) const {
+	glm::vec2 position = glm::vec2(positions[a]);
+	glm::vec2 velocity = velocities[a];
+
+	//nearest neighbors, from the 3x3 block of cells around the agent (cells are neighbor_distance wide):
+	scratch.neighbors.clear();
+	float range2 = neighbor_distance * neighbor_distance;
+	glm::ivec2 center = glm::ivec2(glm::floor(position / hash_cell));
+	uint32_t buckets[9];
+	for (uint32_t c = 0; c < 9; ++c) {
+		buckets[c] = hash_bucket(center + glm::ivec2(int32_t(c % 3) - 1, int32_t(c / 3) - 1));
+		//(cells can share a bucket, which should only be searched once)
+		bool repeat = false;
+		for (uint32_t p = 0; p < c; ++p) repeat = repeat || (buckets[p] == buckets[c]);
+		if (repeat) continue;
+		for (uint32_t i = hash_first[buckets[c]]; i < hash_first[buckets[c] + 1]; ++i) {
+			uint32_t other = hash_agents[i];
+			if (other == a) continue;
+			glm::vec2 to = glm::vec2(positions[other]) - position;
+			float dis2 = glm::dot(to, to);
+			if (dis2 >= range2) continue;
+			//keep the closest max_neighbors, sorted:
+			if (scratch.neighbors.size() < max_neighbors) scratch.neighbors.emplace_back(dis2, other);
+			else if (!scratch.neighbors.empty() && dis2 < scratch.neighbors.back().first) scratch.neighbors.back() = std::make_pair(dis2, other);
+			else continue;
+			for (uint32_t n = uint32_t(scratch.neighbors.size()) - 1; n > 0 && scratch.neighbors[n].first < scratch.neighbors[n-1].first; --n) {
+				std::swap(scratch.neighbors[n], scratch.neighbors[n-1]);
+			}
+		}
+	}
+
+	//each neighbor rules out the velocities that would hit it within time_horizon (sharing the avoiding half each):
+	scratch.lines.clear();
+	float inv_horizon = 1.0f / time_horizon;
+	for (auto const &n : scratch.neighbors) {
+		uint32_t other = n.second;
+		glm::vec2 relative_position = glm::vec2(positions[other]) - position;
+		glm::vec2 relative_velocity = velocity - velocities[other];
+		float dis2 = n.first;
+		float combined_radius = radii[a] + radii[other];
+		float combined_radius2 = combined_radius * combined_radius;
+
+		Line line;
+		glm::vec2 u;
+		if (dis2 > combined_radius2) {
+			//not colliding yet; w is from the cutoff circle's center to the relative velocity:
+			glm::vec2 w = relative_velocity - inv_horizon * relative_position;
+			float w_length2 = glm::dot(w, w);
+			float dot1 = glm::dot(w, relative_position);
+			if (dot1 < 0.0f && dot1 * dot1 > combined_radius2 * w_length2) {
+				//project on the cutoff circle:
+				float w_length = std::sqrt(w_length2);
+				glm::vec2 unit_w = w / w_length;
+				line.direction = glm::vec2(unit_w.y, -unit_w.x);
+				u = (combined_radius * inv_horizon - w_length) * unit_w;
+			} else {
+				//project on the legs of the cone:
+				float leg = std::sqrt(dis2 - combined_radius2);
+				if (det(relative_position, w) > 0.0f) {
+					line.direction = glm::vec2(relative_position.x * leg - relative_position.y * combined_radius, relative_position.x * combined_radius + relative_position.y * leg) / dis2;
+				} else {
+					line.direction = -glm::vec2(relative_position.x * leg + relative_position.y * combined_radius, -relative_position.x * combined_radius + relative_position.y * leg) / dis2;
+				}
+				u = glm::dot(relative_velocity, line.direction) * line.direction - relative_velocity;
+			}
+		} else {
+			//already overlapping, so push apart within this tick:
+			float inv_elapsed = 1.0f / elapsed;
+			glm::vec2 w = relative_velocity - inv_elapsed * relative_position;
+			float w_length = glm::length(w);
+			glm::vec2 unit_w = (w_length > 0.0f ? w / w_length : glm::vec2(1.0f, 0.0f));
+			line.direction = glm::vec2(unit_w.y, -unit_w.x);
+			u = (combined_radius * inv_elapsed - w_length) * unit_w;
+		}
+		line.point = velocity + 0.5f * u;
+		scratch.lines.emplace_back(line);
+	}
+
+	glm::vec2 result;
+	uint32_t satisfied = linear_program2(scratch.lines, max_speeds[a], preferred[a], false, &result);
+	if (satisfied < scratch.lines.size()) {
+		linear_program3(scratch.lines, satisfied, max_speeds[a], scratch.projected, &result);
+	}
+	return result;
+}
+
+void Crowd::update(float elapsed) {
+	uint32_t count = uint32_t(triangles.size());
+	if (count == 0 || elapsed <= 0.0f) return;
+
+	for (uint32_t a = 0; a < count; ++a) {
+		positions[a] = walk_mesh.world_point(agent(a));
+	}
+	build_hash();
+
+	//every agent picks its velocity from last tick's velocities, then they all move:
+	scratch_next.resize(count);
+	scratch_per_job.resize((count + AvoidPerJob - 1) / AvoidPerJob);
+	Jobs::parallel_for(count, AvoidPerJob, [this, elapsed](uint32_t begin, uint32_t end) {
+		Scratch &job_scratch = scratch_per_job[begin / AvoidPerJob];
+		for (uint32_t a = begin; a < end; ++a) {
+			scratch_next[a] = avoid(a, elapsed, job_scratch);
+		}
+	});
+	scratch_steps.resize(count);
+	for (uint32_t a = 0; a < count; ++a) {
+		scratch_steps[a] = glm::vec3(scratch_next[a] * elapsed, 0.0f);
+	}
+	walk_mesh.walk(count, triangles.data(), weights.data(), scratch_steps.data());
+
+	//remember how agents actually moved (walls stop them), which is what their neighbors will see:
+	for (uint32_t a = 0; a < count; ++a) {
+		glm::vec3 at = walk_mesh.world_point(agent(a));
+		velocities[a] = glm::vec2(at - positions[a]) / elapsed;
+		positions[a] = at;
+	}
+}
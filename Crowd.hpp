@@ -0,0 +1,76 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//"Crowd" moves many agents over a WalkMesh without them walking through each other.
+// Each tick, every agent's preferred velocity (set by the game, e.g., from a FlowField or Pathfinder)
+// is adjusted with optimal reciprocal collision avoidance (ORCA, as in the RVO2 library):
+// each nearby agent rules out a half-plane of velocities, and the agent takes the allowed velocity
+// closest to the one it wanted. Velocities live in the floor plane (xy).
+// Neighbors are found through a spatial hash of agent positions, rebuilt every tick,
+// so the cost grows linearly with the number of agents.
+
+struct Crowd {
+	Crowd(WalkMesh const &walk_mesh);
+
+	WalkMesh const &walk_mesh;
+
+	//add an agent standing at 'at'; returns its index:
+	uint32_t add_agent(WalkMesh::WalkPoint const &at, float radius = 0.3f, float max_speed = 2.0f);
+
+	WalkMesh::WalkPoint agent(uint32_t index) const {
+		WalkMesh::WalkPoint wp;
+		wp.triangle = triangles[index];
+		wp.weights = weights[index];
+		return wp;
+	}
+
+	//pick avoiding velocities (split across the job pool) and walk every agent (with the batched WalkMesh::walk):
+	void update(float elapsed);
+
+	//avoidance parameters:
+	float neighbor_distance = 3.0f; //agents further apart than this ignore each other
+	uint32_t max_neighbors = 10; //...as do all but this many nearest
+	float time_horizon = 1.5f; //seconds ahead that collisions are avoided
+
+	//agents (one entry per agent in each array):
+	std::vector< uint32_t > triangles; //walk points, as arrays for WalkMesh::walk
+	std::vector< glm::vec3 > weights;
+	std::vector< glm::vec3 > positions; //world positions (updated by update)
+	std::vector< glm::vec2 > preferred; //velocity each agent wants (set by the game before update)
+	std::vector< glm::vec2 > velocities; //velocity each agent actually moved at last update
+	std::vector< float > radii;
+	std::vector< float > max_speeds;
+
+	//------ internals ------
+
+	//spatial hash over the floor plane: bucket b's agents are hash_agents[hash_first[b]] up to hash_agents[hash_first[b+1]]:
+	float hash_cell = 3.0f; //(neighbor_distance, as of the last rebuild)
+	std::vector< uint32_t > hash_first;
+	std::vector< uint32_t > hash_agents;
+	std::vector< uint32_t > hash_fill; //(scratch for building)
+	uint32_t hash_bucket(glm::ivec2 const &cell) const;
+	void build_hash();
+
+	//ORCA half-plane: allowed velocities are to the left of 'direction' through 'point':
+	struct Line {
+		glm::vec2 point;
+		glm::vec2 direction;
+	};
+	//scratch space for avoid (re-used between agents and ticks; one per job, since agents are split into jobs of AvoidPerJob):
+	struct Scratch {
+		std::vector< std::pair< float, uint32_t > > neighbors;
+		std::vector< Line > lines;
+		std::vector< Line > projected;
+	};
+	static constexpr const uint32_t AvoidPerJob = 256;
+	std::vector< Scratch > scratch_per_job;
+	glm::vec2 avoid(uint32_t agent, float elapsed, Scratch &scratch) const; //velocity for one agent
+
+	std::vector< glm::vec2 > scratch_next;
+	std::vector< glm::vec3 > scratch_steps;
+};
@@ -0,0 +1,70 @@
+#include "ECS.hpp"
+#include "Jobs.hpp"
+
+#include <atomic>
+
+constexpr ECS::Entity ECS::NoEntity;
+
+ECS::Entity ECS::create() {
+	Entity entity;
+	if (!free_entities.empty()) {
+		entity = free_entities.back();
+		free_entities.pop_back();
+		alive_flags[entity] = true;
+	} else {
+		entity = Entity(alive_flags.size());
+		alive_flags.emplace_back(true);
+	}
+	return entity;
+}
+
+void ECS::destroy(Entity entity) {
+	assert(alive(entity));
+	for (auto &storage : storages) {
+		if (storage) storage->remove(entity);
+	}
+	alive_flags[entity] = false;
+	free_entities.emplace_back(entity);
+}
+
+uint32_t ECS::next_type_id() {
+	static std::atomic< uint32_t > next(0);
+	return next++;
+}
+
+void Schedule::add(std::string const &name, uint64_t reads, uint64_t writes, std::function< void() > const &run) {
+	systems.emplace_back();
+	System &system = systems.back();
+	system.name = name;
+	system.reads = reads;
+	system.writes = writes;
+	system.run = run;
+
+	//the system goes in the stage after the last one holding a system it conflicts with:
+	uint32_t stage = 0;
+	for (uint32_t s = uint32_t(stages.size()); s > 0; --s) {
+		bool conflict = false;
+		for (uint32_t other : stages[s-1]) {
+			System const &o = systems[other];
+			if ((writes & (o.reads | o.writes)) || (o.writes & reads)) conflict = true;
+		}
+		if (conflict) {
+			stage = s;
+			break;
+		}
+	}
+	if (stage == stages.size()) stages.emplace_back();
+	stages[stage].emplace_back(uint32_t(systems.size() - 1));
+}
+
+void Schedule::run() {
+	for (auto const &stage : stages) {
+		//the rest of the stage's systems go to the job pool, while this thread runs the first:
+		Jobs::Counter counter;
+		for (uint32_t i = 1; i < stage.size(); ++i) {
+			Jobs::run(systems[stage[i]].run, &counter);
+		}
+		systems[stage[0]].run();
+		Jobs::wait(counter);
+	}
+}
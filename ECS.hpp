@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+//"ECS" keeps game state as entities (just ids) with components (plain values of any type) attached.
+// Components are stored sparse-set style: each type has a packed array of components, a packed array of
+// which entity each belongs to, and a sparse array from entity to packed index.
+// So adding, removing, and finding a component are O(1), and visiting every component of a type
+// walks contiguous memory with no holes (removal moves the last component into the gap).
+
+struct ECS {
+	typedef uint32_t Entity;
+	static constexpr Entity NoEntity = -1U;
+
+	//entity ids are re-used after being destroyed:
+	Entity create();
+	void destroy(Entity entity); //(also removes its components)
+	bool alive(Entity entity) const { return entity < alive_flags.size() && alive_flags[entity]; }
+
+	//storage for one component type:
+	struct StorageBase {
+		virtual ~StorageBase() { }
+		virtual void remove(Entity entity) = 0;
+	};
+	template< typename T >
+	struct Storage : StorageBase {
+		std::vector< uint32_t > sparse; //entity -> index in entities/components (or -1U)
+		std::vector< Entity > entities; //packed
+		std::vector< T > components; //packed, in the same order
+
+		bool has(Entity entity) const { return entity < sparse.size() && sparse[entity] != -1U; }
+		T &get(Entity entity) { assert(has(entity)); return components[sparse[entity]]; }
+		T &add(Entity entity, T const &value) {
+			if (entity >= sparse.size()) sparse.resize(entity + 1, -1U);
+			if (sparse[entity] != -1U) return components[sparse[entity]] = value;
+			sparse[entity] = uint32_t(entities.size());
+			entities.emplace_back(entity);
+			components.emplace_back(value);
+			return components.back();
+		}
+		virtual void remove(Entity entity) override {
+			if (!has(entity)) return;
+			uint32_t index = sparse[entity];
+			if (index + 1 != entities.size()) {
+				sparse[entities.back()] = index;
+				entities[index] = entities.back();
+				components[index] = std::move(components.back());
+			}
+			entities.pop_back();
+			components.pop_back();
+			sparse[entity] = -1U;
+		}
+	};
+
+	//NOTE: add/remove change the layout of a type's storage, so they must not run while a system is visiting that type
+	template< typename T >
+	T &add(Entity entity, T const &value = T()) {
+		assert(alive(entity));
+		return storage< T >().add(entity, value);
+	}
+	template< typename T >
+	void remove(Entity entity) {
+		if (Storage< T > *found = find< T >()) found->remove(entity);
+	}
+	template< typename T >
+	bool has(Entity entity) const {
+		Storage< T > const *found = find< T >();
+		return found && found->has(entity);
+	}
+	template< typename T >
+	T &get(Entity entity) {
+		Storage< T > *found = find< T >();
+		assert(found);
+		return found->get(entity);
+	}
+
+	//call 'fn(entity, A &, Rest &...)' for every entity that has all the listed components:
+	// (visits A's packed array in order, so list the rarest component first)
+	template< typename A, typename... Rest, typename F >
+	void each(F const &fn) {
+		Storage< A > *first = find< A >();
+		if (!first) return;
+		for (uint32_t i = 0; i < first->entities.size(); ++i) {
+			Entity entity = first->entities[i];
+			if (!has_all< Rest... >(entity)) continue;
+			fn(entity, first->components[i], get< Rest >(entity)...);
+		}
+	}
+
+	//every type (component or not) gets a small number, in order of first use; Schedule uses these to name what systems touch:
+	template< typename T >
+	static uint32_t type_id() {
+		static uint32_t const id = next_type_id();
+		return id;
+	}
+	static uint32_t next_type_id();
+
+	//------ internals ------
+
+	std::vector< bool > alive_flags;
+	std::vector< Entity > free_entities;
+	std::vector< std::unique_ptr< StorageBase > > storages; //indexed by type_id
+
+	template< typename T >
+	Storage< T > *find() const {
+		uint32_t id = type_id< T >();
+		return (id < storages.size() ? static_cast< Storage< T > * >(storages[id].get()) : nullptr);
+	}
+	template< typename T >
+	Storage< T > &storage() {
+		uint32_t id = type_id< T >();
+		if (id >= storages.size()) storages.resize(id + 1);
+		if (!storages[id]) storages[id].reset(new Storage< T >());
+		return *static_cast< Storage< T > * >(storages[id].get());
+	}
+	template< typename... Ts >
+	bool has_all(Entity entity) const {
+		bool all = true;
+		(void)entity;
+		(void)std::initializer_list< int >{ (all = all && has< Ts >(entity), 0)... };
+		return all;
+	}
+};
+
+//"Schedule" runs a list of systems (functions over an ECS, or anything else) in order,
+// except that systems which could not tell the difference run at the same time:
+// each system says which types it reads and writes (as a mask from Schedule::types),
+// and runs alongside every earlier system it doesn't conflict with (one writes what the other reads or writes).
+// Systems must not add or remove components of types other systems in their stage read or write.
+
+struct Schedule {
+	//bits for types (any types: components, or shared things like a Pathfinder):
+	template< typename... Ts >
+	static uint64_t types() {
+		uint64_t mask = 0;
+		(void)std::initializer_list< int >{ (mask |= bit(ECS::type_id< Ts >()), 0)... };
+		return mask;
+	}
+	static uint64_t bit(uint32_t id) {
+		assert(id < 64 && "Schedule only tracks the first 64 types used.");
+		return uint64_t(1) << id;
+	}
+
+	void add(std::string const &name, uint64_t reads, uint64_t writes, std::function< void() > const &run);
+
+	//run all systems, stage by stage:
+	void run();
+
+	struct System {
+		std::string name;
+		uint64_t reads;
+		uint64_t writes;
+		std::function< void() > run;
+	};
+	std::vector< System > systems;
+	//systems grouped into stages that can each run at once (systems in a stage run as jobs, see Jobs.hpp):
+	std::vector< std::vector< uint32_t > > stages;
+};
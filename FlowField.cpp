@@ -0,0 +1,113 @@
+#include "FlowField.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cassert>
+
+//values are stored minus an offset that grows as the target moves; past this, start over so they keep their precision:
+static constexpr const float MaxOffset = 1000.0f;
+
+FlowField::FlowField(WalkMesh const &walk_mesh_) : walk_mesh(walk_mesh_) {
+	uint32_t count = walk_mesh.triangle_count;
+	values.assign(count, std::numeric_limits< float >::infinity());
+	next.assign(count, -1U);
+	centers.reserve(count);
+	for (uint32_t t = 0; t < count; ++t) {
+		glm::uvec3 const &tri = walk_mesh.triangles[t];
+		centers.emplace_back((walk_mesh.vertices[tri.x] + walk_mesh.vertices[tri.y] + walk_mesh.vertices[tri.z]) / 3.0f);
+	}
+	//every triangle is pushed at most once per edge it can be reached by, plus the target:
+	heap.reserve(3 * size_t(count) + 1);
+}
+
+void FlowField::set_target(WalkMesh::WalkPoint const &target_) {
+	assert(target_.triangle < walk_mesh.triangle_count);
+	WalkMesh::WalkPoint old = target;
+	target = target_;
+	if (old.triangle == target.triangle) return;
+
+	//start over the first time, if the new target couldn't be reached from the old one, or if the offset is getting large:
+	if (old.triangle == -1U || values[target.triangle] == std::numeric_limits< float >::infinity() || offset > MaxOffset) {
+		rebuild();
+		return;
+	}
+
+	//every distance grows by at most the distance the target moved, so raise them all by that (which changes no 'next'):
+	offset += distance(target.triangle);
+	//...then lower the ones the new target is closer to than that:
+	// (the old target is left to be found again, since it needs a 'next' now)
+	values[old.triangle] = std::numeric_limits< float >::infinity();
+	values[target.triangle] = -offset;
+	next[target.triangle] = -1U;
+	heap.clear();
+	heap.emplace_back(values[target.triangle], target.triangle);
+	++repairs;
+	propagate();
+}
+
+void FlowField::rebuild() {
+	std::fill(values.begin(), values.end(), std::numeric_limits< float >::infinity());
+	std::fill(next.begin(), next.end(), -1U);
+	offset = 0.0f;
+	values[target.triangle] = 0.0f;
+	heap.clear();
+	heap.emplace_back(0.0f, target.triangle);
+	++rebuilds;
+	propagate();
+}
+
+void FlowField::propagate() {
+	auto heap_order = std::greater< std::pair< float, uint32_t > >();
+	std::make_heap(heap.begin(), heap.end(), heap_order);
+	last_touched = 0;
+	while (!heap.empty()) {
+		std::pop_heap(heap.begin(), heap.end(), heap_order);
+		float value = heap.back().first;
+		uint32_t triangle = heap.back().second;
+		heap.pop_back();
+		//skip stale heap entries:
+		if (value > values[triangle]) continue;
+		++last_touched;
+
+		glm::uvec3 const &links = walk_mesh.neighbors[triangle];
+		for (uint32_t e = 0; e < 3; ++e) {
+			if (links[e] == -1U) continue;
+			uint32_t other = links[e] / 3;
+			float through = value + glm::length(centers[other] - centers[triangle]);
+			if (through >= values[other]) continue;
+			values[other] = through;
+			next[other] = triangle;
+			heap.emplace_back(through, other);
+			std::push_heap(heap.begin(), heap.end(), heap_order);
+		}
+	}
+}
+
+glm::vec3 FlowField::direction(WalkMesh::WalkPoint const &wp) const {
+	assert(wp.triangle < walk_mesh.triangle_count);
+	glm::vec3 at = walk_mesh.world_point(wp);
+	glm::vec3 to;
+	if (wp.triangle == target.triangle) {
+		to = walk_mesh.world_point(target);
+	} else if (next[wp.triangle] == -1U) {
+		return glm::vec3(0.0f); //(unreachable)
+	} else {
+		//head for the middle of the edge into the next triangle:
+		glm::uvec3 const &tri = walk_mesh.triangles[wp.triangle];
+		glm::uvec3 const &links = walk_mesh.neighbors[wp.triangle];
+		uint32_t e = 0;
+		while (e < 2 && (links[e] == -1U || links[e] / 3 != next[wp.triangle])) ++e;
+		to = 0.5f * (walk_mesh.vertices[tri[e]] + walk_mesh.vertices[tri[(e+1)%3]]);
+	}
+	//(already on that edge? then head on into the next triangle)
+	if (wp.triangle != target.triangle && glm::length(to - at) < 1e-4f) {
+		to = centers[next[wp.triangle]];
+	}
+	//keep the direction along the triangle:
+	glm::vec3 normal = walk_mesh.world_normal(wp);
+	glm::vec3 along = (to - at) - normal * glm::dot(normal, to - at);
+	float length = glm::length(along);
+	if (length < 1e-6f) return glm::vec3(0.0f);
+	return along / length;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+//"FlowField" keeps, for every triangle of a WalkMesh, the distance to a target and the next triangle toward it,
+// so any number of agents can pursue the target by reading their own triangle (no per-agent search).
+//
+// When the target moves to another triangle the field is repaired rather than rebuilt:
+//  moving the target by d (the old distance between the two triangles) makes no distance grow by more than d,
+//  so the whole field is raised by d at once (as an offset, so without touching it) and then
+//  only the triangles that got closer than that are updated, by a Dijkstra wavefront out of the new target.
+// So the work per move is the region where the way to the target actually changed (small when, e.g.,
+//  the target moves further into a side room), and nothing per agent.
+
+struct FlowField {
+	FlowField(WalkMesh const &walk_mesh);
+
+	WalkMesh const &walk_mesh;
+
+	//move the target (repairs the field if the target changed triangles):
+	void set_target(WalkMesh::WalkPoint const &target);
+
+	//distance (along triangle centers) from a triangle to the target's triangle; infinity if it can't be reached:
+	float distance(uint32_t triangle) const { return values[triangle] + offset; }
+
+	//which way an agent standing at 'wp' should walk (unit length, along the mesh), or zero once it is at the target:
+	glm::vec3 direction(WalkMesh::WalkPoint const &wp) const;
+
+	//counters (e.g., for a debug overlay):
+	uint32_t rebuilds = 0; //full Dijkstra passes
+	uint32_t repairs = 0; //incremental updates
+	uint32_t last_touched = 0; //triangles updated by the most recent rebuild or repair
+
+	//------ internals ------
+
+	WalkMesh::WalkPoint target;
+	std::vector< float > values; //distance to target, minus offset
+	float offset = 0.0f;
+	std::vector< uint32_t > next; //neighbor one step closer to the target (or -1U at the target or if unreachable)
+	std::vector< glm::vec3 > centers; //triangle centroids, between which distances are measured
+
+	void rebuild(); //full Dijkstra out of target.triangle
+	void propagate(); //Dijkstra out of whatever is in the heap, only lowering values
+
+	std::vector< std::pair< float, uint32_t > > heap; //(pooled)
+};
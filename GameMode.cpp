@@ -6,6 +6,7 @@
 #include "Scene.hpp"
 #include "MeshBuffer.hpp"
 #include "WalkMesh.hpp"
+#include "Pathfinder.hpp"
 #include "gl_errors.hpp" //helper for dumpping OpenGL error messages
 #include "read_chunk.hpp" //helper for reading a vector of structures from a file
 #include "data_path.hpp" //helper to get paths relative to executable
@@ -25,9 +26,7 @@
 MeshBuffer::Mesh dungeon_mesh;
 MeshBuffer::Mesh walk_mesh;
 MeshBuffer::Mesh monster_mesh;
-glm::vec3 monsterPos = glm::vec3(0.0f, 20.0f, 1.0f);
-glm::vec3 escapePos = glm::vec3(10.0, 10.0, 10.0);
-glm::vec3 playerPos = glm::vec3(0.0f, -10.0f, 1.0f);
+glm::vec3 const hallPos = glm::vec3(-0.45f, -8.0f, 0.0f);
 //float playerSpeed = 10.0; //WALKMESH
 
 Load< MeshBuffer > dungeon_meshes(LoadTagDefault, [](){
@@ -47,11 +46,27 @@ Load< GLuint > dungeon_meshes_for_vertex_color_program(LoadTagDefault, [](){
 });
 
 
+//sounds are routed around the hall's walls:
+Load< SoundPropagation > dungeon_propagation(LoadTagDefault, [](){
+	glm::mat4x3 hall_to_world = glm::mat4x3(
+		glm::vec3(1.0f, 0.0f, 0.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::vec3(0.0f, 0.0f, 1.0f),
+		hallPos
+	);
+	return new SoundPropagation(data_path("meshes.pnc"), "hall", hall_to_world, 0.25f);
+});
+
+//the floor the monster walks on (cooked by walkmesh_cook):
+Load< WalkMesh > dungeon_walk_mesh(LoadTagDefault, [](){
+	return new WalkMesh(data_path("walkmesh.wm"));
+});
+
 Load< Sound::Sample > roar(LoadTagDefault, [](){
 	return new Sound::Sample(data_path("roar.wav"));
 });
 
-GameMode::GameMode() {
+GameMode::GameMode() : propagation(*dungeon_propagation), pathfinder(*dungeon_walk_mesh) {
 	//----------------
 	//set up scene:
 	//TODO: this should load the scene from a file!
@@ -60,34 +75,123 @@ GameMode::GameMode() {
 
 }
 
+static Scene::Object *attach_object(Scene &scene, Scene::Transform *transform, std::string const &name) {
+	Scene::Object *object = scene.new_object(transform);
+	object->program = vertex_color_program->program;
+	object->program_mvp_mat4 = vertex_color_program->object_to_clip_mat4;
+	object->program_mv_mat4x3 = vertex_color_program->object_to_light_mat4x3;
+	object->program_itmv_mat3 = vertex_color_program->normal_to_light_mat3;
+	object->vao = *dungeon_meshes_for_vertex_color_program;
+	MeshBuffer::Mesh const &mesh = dungeon_meshes->lookup(name);
+	object->start = mesh.start;
+	object->count = mesh.count;
+	return object;
+}
+
 void GameMode::initGame(){
-	auto attach_object = [this](Scene::Transform *transform, std::string const &name) {
-		Scene::Object *object = scene.new_object(transform);
-		object->program = vertex_color_program->program;
-		object->program_mvp_mat4 = vertex_color_program->object_to_clip_mat4;
-		object->program_mv_mat4x3 = vertex_color_program->object_to_light_mat4x3;
-		object->program_itmv_mat3 = vertex_color_program->normal_to_light_mat3;
-		object->vao = *dungeon_meshes_for_vertex_color_program;
-		MeshBuffer::Mesh const &mesh = dungeon_meshes->lookup(name);
-		object->start = mesh.start;
-		object->count = mesh.count;
-		return object;
-	};
 	{ //do dungeon and monster stuff here
 		Scene::Transform *transform1 = scene.new_transform();
-		transform1->position = glm::vec3(-0.45f, -8.0f, 0.0f);
-		dungeon = attach_object(transform1, "hall");
-		Scene::Transform *transform2 = scene.new_transform();
-		transform2->position = monsterPos;
-		monster = attach_object(transform2, "monster");
+		transform1->position = hallPos;
+		dungeon = attach_object(scene, transform1, "hall");
+		//roars are heard around the hall's walls:
+		scene.sound_propagation = &propagation;
+		//...and ring in the hall (reverb is tuned to the hall's size):
+		hall_reverb = Sound::add_reverb_zone(propagation.geometry_min, propagation.geometry_max);
 	}
 
 	{ //Camera looking at the origin:
 		Scene::Transform *transform = scene.new_transform();
-		transform->position = playerPos; //player is camera
+		transform->position = glm::vec3(0.0f, -10.0f, 1.0f); //player is camera
 		//Cameras look along -z, so rotate view to look at origin:
 		transform->rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 		camera = scene.new_camera(transform);
+
+		player = ecs.create();
+		ecs.add< Scene::Transform * >(player, transform);
+		ecs.add< Position >(player).at = transform->position;
+		ecs.add< Previous >(player).at = transform->position;
+		ecs.add< Velocity >(player);
+		ecs.add< Controlled >(player);
+		//(colliders are tall, so only the floor plan matters; the camera is turned so its local y is world z)
+		Scene::Collider *collider = scene.new_collider(transform);
+		collider->radius = glm::vec3(1.5f, 10.0f, 1.5f);
+		collider->layer = PlayerLayer;
+		ecs.add< Scene::Collider * >(player, collider);
+	}
+
+	spawn_monster(glm::vec3(0.0f, 20.0f, 1.0f));
+
+	{ //the way out is a trigger zone:
+		Scene::Transform *transform = scene.new_transform();
+		transform->position = glm::vec3(10.0f, 10.0f, 10.0f);
+		ECS::Entity escape = ecs.create();
+		ecs.add< Scene::Transform * >(escape, transform);
+		Scene::Collider *collider = scene.new_collider(transform);
+		collider->radius = glm::vec3(2.5f, 1.5f, 10.0f);
+		collider->layer = EscapeLayer;
+		ecs.add< Scene::Collider * >(escape, collider);
+	}
+
+	{ //simulation systems, in order (Schedule runs those that don't conflict at the same time):
+		simulation.add("remember", Schedule::types< Position >(), Schedule::types< Previous >(), [this](){
+			ecs.each< Previous, Position >([](ECS::Entity, Previous &previous, Position const &position) {
+				previous.at = position.at;
+			});
+		});
+		simulation.add("steer", Schedule::types< Controlled >(), Schedule::types< Velocity >(), [this](){
+			glm::mat3 directions = glm::mat3_cast(camera->transform->rotation);
+			glm::vec3 move = glm::vec3(0.0f);
+			if (controls.right) move += directions[0];
+			if (controls.left) move -= directions[0];
+			if (controls.backward) move += directions[2];
+			if (controls.forward) move -= directions[2];
+			ecs.each< Controlled, Velocity >([&move](ECS::Entity, Controlled const &, Velocity &velocity) {
+				velocity.value = 5.0f * move;
+			});
+		});
+		simulation.add("hunt", Schedule::types< Position >(), Schedule::types< Hunter, WalkMesh::WalkPoint, Pathfinder >(), [this](){
+			ecs.each< Hunter, WalkMesh::WalkPoint >([this](ECS::Entity, Hunter &hunter, WalkMesh::WalkPoint &at) {
+				hunter.repath_countdown -= Mode::FixedStep;
+				if (ecs.has< Position >(hunter.target)) {
+					WalkMesh::WalkPoint target_at = dungeon_walk_mesh->start(ecs.get< Position >(hunter.target).at);
+					if (dungeon_walk_mesh->visible(at, target_at)) {
+						//charge straight at a target in sight:
+						hunter.path.assign(1, dungeon_walk_mesh->world_point(target_at));
+						hunter.waypoint = 0;
+						hunter.repath_countdown = 0.0f; //(so it re-paths as soon as the target is out of sight)
+					} else if (hunter.repath_countdown <= 0.0f) {
+						//otherwise re-path now and then (cheap, since corridors are cached per start/goal triangle):
+						hunter.repath_countdown = hunter.repath_interval;
+						pathfinder.find_path(at, target_at, &hunter.path);
+						hunter.waypoint = 0;
+					}
+				}
+				//...and walk along the path in between:
+				float remaining = hunter.speed * Mode::FixedStep;
+				while (remaining > 0.0f && hunter.waypoint < hunter.path.size()) {
+					glm::vec3 to_waypoint = hunter.path[hunter.waypoint] - dungeon_walk_mesh->world_point(at);
+					float distance = glm::length(to_waypoint);
+					if (distance <= remaining) {
+						dungeon_walk_mesh->walk(at, to_waypoint);
+						remaining -= distance;
+						++hunter.waypoint;
+					} else {
+						dungeon_walk_mesh->walk(at, to_waypoint * (remaining / distance));
+						remaining = 0.0f;
+					}
+				}
+			});
+		});
+		simulation.add("move", Schedule::types< Velocity >(), Schedule::types< Position >(), [this](){
+			ecs.each< Velocity, Position >([](ECS::Entity, Velocity const &velocity, Position &position) {
+				position.at += velocity.value * Mode::FixedStep;
+			});
+		});
+		simulation.add("stand", Schedule::types< Hunter, WalkMesh::WalkPoint >(), Schedule::types< Position >(), [this](){
+			ecs.each< Hunter, WalkMesh::WalkPoint, Position >([](ECS::Entity, Hunter const &hunter, WalkMesh::WalkPoint const &at, Position &position) {
+				position.at = dungeon_walk_mesh->world_point(at) + hunter.height * dungeon_walk_mesh->world_normal(at);
+			});
+		});
 	}
 
 /* WALKMESH
@@ -97,14 +201,31 @@ void GameMode::initGame(){
 	WalkMesh::WalkPoint walk_point;
 	walk_point = wmesh.start(playerPos);
 */
+}
 
-	//don't need be three dimensional since monster won't fall on top of player
-	std::vector<int> playerDim = {3, 3}; 
-	std::vector<int> monsterDim = {5, 5};
-	std::vector<int> escapeDim = {5, 3};
+void GameMode::spawn_monster(glm::vec3 const &at) {
+	ECS::Entity monster = ecs.create();
+	Hunter &hunter = ecs.add< Hunter >(monster);
+	hunter.target = player;
+	WalkMesh::WalkPoint &walk_point = ecs.add< WalkMesh::WalkPoint >(monster, dungeon_walk_mesh->start(at));
+	glm::vec3 position = dungeon_walk_mesh->world_point(walk_point) + hunter.height * dungeon_walk_mesh->world_normal(walk_point);
+	ecs.add< Position >(monster).at = position;
+	ecs.add< Previous >(monster).at = position;
+
+	Scene::Transform *transform = scene.new_transform();
+	transform->position = position;
+	ecs.add< Scene::Transform * >(monster, transform);
+	attach_object(scene, transform, "monster");
+	Scene::Collider *collider = scene.new_collider(transform);
+	collider->radius = glm::vec3(2.5f, 2.5f, 10.0f);
+	collider->layer = MonsterLayer;
+	ecs.add< Scene::Collider * >(monster, collider);
+	//roars are attached to the monster, so they follow it around:
+	ecs.add< Scene::SoundEmitter * >(monster, scene.new_sound_emitter(transform));
 }
 
 GameMode::~GameMode() {
+	Sound::remove_reverb_zone(hall_reverb);
 }
 
 bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -130,6 +251,10 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			controls.right = (evt.type == SDL_KEYDOWN);
 			return true;
 		}
+		else if (evt.key.keysym.scancode == SDL_SCANCODE_F3) {
+			if (evt.type == SDL_KEYDOWN) show_audio_stats = !show_audio_stats;
+			return true;
+		}
 		else if (evt.key.keysym.scancode == SDL_SCANCODE_ESCAPE) {
 			//open pause menu on 'ESCAPE':
 			show_pause_menu(false, false);
@@ -141,86 +266,65 @@ bool GameMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 
 void GameMode::liveDie() {
-	//check for collision between player and monster
-	if (camera->transform->position[0]<monsterPos[0]+monsterDim[0] and
-		camera->transform->position[0]+playerDim[0]>monsterPos[0] and
-		camera->transform->position[1]<monsterPos[1]+monsterDim[1] and
-		camera->transform->position[1]+playerDim[1]>monsterDim[1]) {
-		//round lost
-		show_pause_menu(true, true);
-	}
-	//check for collision between player and exit of dungeon
-	if (camera->transform->position[0]<escapePos[0]+escapeDim[0] and
-		camera->transform->position[0]+playerDim[0]>escapePos[0] and
-		camera->transform->position[1]<escapePos[1]+escapeDim[1] and
-		camera->transform->position[1]+playerDim[1]>escapeDim[1]) {
-		//round won
-		show_pause_menu(true, false);
-	}
-	/*
-	if (playerPos[0]<monsterPos[0]+monsterDim[0] and
-		playerPos[0]+playerDim[0]>monsterPos[0] and
-		playerPos[1]<monsterPos[1]+monsterDim[1] and
-		playerPos[1]+playerDim[1]>monsterDim[1]) {
-		//round lost
-		return;
-	}
-	//check for collision between player and exit of dungeon
-	if (playerPos[0]<escapePos[0]+escapeDim[0] and
-		playerPos[0]+playerDim[0]>escapePos[0] and
-		playerPos[1]<escapePos[1]+escapeDim[1] and
-		playerPos[1]+playerDim[1]>escapeDim[1]) {
-		//round won
-		return;
+	//colliders are tested where the simulation has things (update() then moves them to where they are drawn):
+	ecs.each< Scene::Transform *, Position >([](ECS::Entity, Scene::Transform *transform, Position const &position) {
+		transform->position = position.at;
+	});
+	scene.update_collisions();
+	for (auto const &contact : scene.contacts) {
+		if (contact.event != Scene::Contact::Enter) continue;
+		Scene::Collider const *other;
+		if (contact.a->layer & PlayerLayer) other = contact.b;
+		else if (contact.b->layer & PlayerLayer) other = contact.a;
+		else continue;
+		if (other->layer & MonsterLayer) {
+			//round lost
+			show_pause_menu(true, true);
+		} else if (other->layer & EscapeLayer) {
+			//round won
+			show_pause_menu(true, false);
+		}
 	}
-	*/
-	return;
 }
 
 
-void GameMode::update(float elapsed) {
-	//check for win/loss condition every time
+void GameMode::fixed_update(float step) {
+	assert(step == Mode::FixedStep); //(systems step by FixedStep)
+	simulation.run();
+	//check for win/loss condition every step
 	liveDie();
-	glm::mat3 directions = glm::mat3_cast(camera->transform->rotation);
-	float amt = 5.0f * elapsed;
-	//player pos is camera->transform->position
-	if (controls.right){
-		camera->transform->position += amt * directions[0];
-	}
-	if (controls.left) {
-		camera->transform->position -= amt * directions[0];
-	}
-	if (controls.backward){
-		camera->transform->position += amt * directions[2];
-	}
-	if (controls.forward) {
-		camera->transform->position -= amt * directions[2];
-	}
+}
+
+void GameMode::update(float elapsed) {
+	//draw (and hear) things between the last two fixed steps:
+	ecs.each< Scene::Transform *, Previous, Position >([this](ECS::Entity, Scene::Transform *transform, Previous const &previous, Position const &position) {
+		transform->position = glm::mix(previous.at, position.at, fixed_alpha);
+	});
+
 	{ //set sound positions:
 		glm::mat4 cam_to_world = camera->transform->make_local_to_world();
 		Sound::listener.set_position( cam_to_world[3] );
 		//camera looks down -z, so right is +x:
 		Sound::listener.set_right( glm::normalize(cam_to_world[0]) );
+		//...and up is +y:
+		Sound::listener.set_up( glm::normalize(cam_to_world[1]) );
+		propagation.set_listener( cam_to_world[3] );
 	}
-	//randomize where the monster is in the dungeon
-	/*
-	monsterPos_countdown -= elapsed;
-	if (monsterPos_countdown <= 0.0f) {
-		//update monster position
-		std::cout << "monster on the move" <<std::endl;
-		//std::cout << "monster position is "<< monster->transform->position << std::endl;
-		monster->transform->position += glm::vec3(5.0, 0, 0);
-		//monsterPos = monsterPos+glm::vec3(20.0, 0, 0);
-		monsterPos_countdown = 4.0f;
-	}
-	*/
-	roar_countdown -= elapsed;
-	if (roar_countdown <= 0.0f) { //CHANGE DUNGEON TO WORLD TO MONSTER TO WORLD
-		//roar_countdown = (rand() / float(RAND_MAX) * 2.0f) + 0.5f;
-		glm::mat4x3 monster_to_world = monster->transform->make_local_to_world();
-		roar->play( monster_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
-		roar_countdown = 5.0f;
+	{ //roars are scheduled on the mixer clock, so they are exactly roar_interval apart (not rounded to frames):
+		uint64_t now = Sound::now();
+		uint64_t interval = uint64_t(roar_interval * Sound::AudioRate);
+		if (next_roar == Sound::NoTime) next_roar = now + interval;
+		//schedule a little ahead of time so the mixer never passes the roar before it is queued:
+		if (next_roar <= now + Sound::AudioRate / 4) { //CHANGE DUNGEON TO WORLD TO MONSTER TO WORLD
+			ecs.each< Scene::SoundEmitter * >([this](ECS::Entity, Scene::SoundEmitter *voice) {
+				glm::mat4x3 monster_to_world = voice->transform->make_local_to_world();
+				glm::vec3 heard_at = propagation.apparent_position(monster_to_world * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+				voice->sample = roar->play_at( next_roar, heard_at );
+			});
+			next_roar += interval;
+		}
 	}
+	scene.update_sound_emitters();
 /* WALKMESH
 	//update position on walk mesh:
 	glm::vec3 step = playerSpeed*elapsed*player_forward;
@@ -267,6 +371,27 @@ void GameMode::draw(glm::uvec2 const &drawable_size) {
 
 	scene.draw(camera);
 
+	if (show_audio_stats) { //audio mixer load meter:
+		glDisable(GL_DEPTH_TEST);
+		Sound::Stats stats = Sound::stats();
+		//the menu font has no digits, so values are drawn as bars:
+		auto bar = [](float amount) {
+			return std::string(uint32_t(glm::clamp(amount, 0.0f, 40.0f)), '*');
+		};
+		float height = 0.05f;
+		float x = -camera->aspect + 0.05f;
+		//turn red when the mixer is close to running out of time or has recently underrun:
+		glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+		if (stats.worst_load > 0.75f || stats.recent_xruns > 0) color = glm::vec4(1.0f, 0.2f, 0.2f, 1.0f);
+		draw_text("LOAD " + bar(stats.load * 20.0f), glm::vec2(x, 0.90f), height, color); //one star per 5% of block time
+		draw_text("PEAK " + bar(stats.worst_load * 20.0f), glm::vec2(x, 0.83f), height, color);
+		draw_text("VOICES " + bar(float(stats.voices)), glm::vec2(x, 0.76f), height, color); //one star per voice
+		if (stats.recent_xruns > 0) {
+			draw_text("XRUN " + bar(float(stats.recent_xruns)), glm::vec2(x, 0.69f), height, color);
+		}
+		glEnable(GL_DEPTH_TEST);
+	}
+
 /*
 	if (Mode::current.get() == this) {
 		glDisable(GL_DEPTH_TEST);
@@ -6,6 +6,9 @@
 #include "WalkMesh.hpp"
 #include "Sound.hpp"
 #include "Scene.hpp"
+#include "SoundPropagation.hpp"
+#include "Pathfinder.hpp"
+#include "ECS.hpp"
 #include "GL.hpp"
 
 #include <SDL.h>
@@ -25,7 +28,10 @@ struct GameMode : public Mode {
 	//The function should return 'true' if it handled the event.
 	virtual bool handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) override;
 
-	//update is called at the start of a new frame, after events are handled:
+	//fixed_update advances the game by one fixed step (moving, hunting, winning and losing):
+	virtual void fixed_update(float step) override;
+
+	//update is called at the start of a new frame, after fixed_update; it places what is drawn and heard:
 	virtual void update(float elapsed) override;
 
 	//draw is called after update:
@@ -43,9 +49,11 @@ struct GameMode : public Mode {
 	glm::uvec2 cursor = glm::vec2(0,0);
 
 //CHANGED
-//checks win/loss conditions every time update is called
+//checks win/loss conditions every fixed step
 void liveDie();
 void initGame();
+//adds a monster that hunts the player:
+void spawn_monster(glm::vec3 const &at);
 //walkmesh stuff
 /*
 std::vector<glm::vec3> const vertices_;
@@ -58,23 +66,54 @@ glm::vec3 player_forward;
 glm::vec3 player_right;
 uint32_t playerSpeed;
 */
-glm::vec3 escapePos;
-glm::vec3 monsterPos;
-std::vector<uint32_t> monsterDim;
-std::vector<uint32_t> escapeDim;
-std::vector<uint32_t> playerDim;
-
-//when this reaches zero, the 'dot' sample is triggered at the small crate:
-float roar_countdown = 5.0f;
-float monsterPos_countdown = 4.0f;
+
+//game state lives in entities (see ECS.hpp) with these components, besides ones that are Scene's and WalkMesh's own types:
+// Scene::Transform * (where the entity is drawn), Scene::Collider *, Scene::SoundEmitter *, WalkMesh::WalkPoint (keeps it on the floor)
+struct Position {
+	glm::vec3 at = glm::vec3(0.0f); //as of the last fixed step
+};
+struct Previous {
+	glm::vec3 at = glm::vec3(0.0f); //as of the fixed step before (entities are drawn between the two)
+};
+struct Velocity {
+	glm::vec3 value = glm::vec3(0.0f);
+};
+struct Controlled { }; //moved by the arrow keys
+struct Hunter { //walks the walk mesh toward a target: straight at it while it is in sight along the floor, else re-pathing every repath_interval seconds
+	ECS::Entity target = ECS::NoEntity;
+	float speed = 2.0f;
+	float height = 1.0f; //(above the walk mesh)
+	float repath_interval = 1.0f;
+	float repath_countdown = 0.0f;
+	std::vector< glm::vec3 > path; //waypoints, from find_path
+	uint32_t waypoint = 0; //next waypoint to walk toward
+};
+ECS ecs;
+Schedule simulation; //systems run by fixed_update
+ECS::Entity player = ECS::NoEntity;
+//touching a monster loses, touching the escape wins (see liveDie):
+enum : uint32_t {
+	PlayerLayer = 1,
+	MonsterLayer = 2,
+	EscapeLayer = 4,
+};
+
+//monsters roar every roar_interval seconds; next_roar is the mixer time of the next one:
+float roar_interval = 5.0f;
+uint64_t next_roar = Sound::NoTime;
 //this 'loop' sample is played at the large crate:
 Scene scene;
-Scene::Object *monster = nullptr;
+SoundPropagation propagation; //(copy of the loaded dungeon_propagation, since it caches routes as the listener moves)
+//monsters walk the dungeon's walk mesh toward the player (sharing one corridor cache):
+Pathfinder pathfinder;
+uint32_t hall_reverb = -1U; //reverb zone covering the hall
 Scene::Object *dungeon = nullptr;
 Scene::Object *large_crate = nullptr;
 Scene::Object *small_crate = nullptr;
 Scene::Camera *camera = nullptr;
 bool mouse_captured = false;
+bool show_audio_stats = false; //toggled with F3
+
 struct {
 		bool forward = false;
 		bool backward = false;
@@ -0,0 +1,173 @@
+#include "Jobs.hpp"
+
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+namespace Jobs {
+
+//one deque per pool thread; deques[0] belongs to the thread that called init:
+struct Deque {
+	std::mutex lock;
+	std::deque< Job > jobs;
+};
+static std::vector< std::unique_ptr< Deque > > deques;
+static std::vector< std::thread > threads;
+
+//index of this thread's deque (threads outside the pool, e.g., the audio thread, use deques[0]):
+static thread_local uint32_t self = -1U;
+
+//idle workers sleep until something is queued:
+static std::atomic< uint32_t > queued(0);
+static std::atomic< bool > stopping(false);
+static std::mutex sleep_lock;
+static std::condition_variable sleep;
+
+static void push(Job const &job);
+
+static void finish(Counter &counter) {
+	std::vector< Job > ready;
+	{
+		std::lock_guard< std::mutex > guard(counter.lock);
+		assert(counter.count > 0);
+		if (--counter.count == 0) ready.swap(counter.waiting);
+	}
+	for (auto const &job : ready) {
+		push(job);
+	}
+}
+
+static void execute(Job const &job) {
+	job.run();
+	if (job.counter) finish(*job.counter);
+}
+
+static void push(Job const &job) {
+	if (deques.empty()) {
+		execute(job);
+		return;
+	}
+	Deque &deque = *deques[self < deques.size() ? self : 0];
+	{
+		std::lock_guard< std::mutex > guard(deque.lock);
+		deque.jobs.emplace_back(job);
+	}
+	++queued;
+	//(taking the lock means no worker is between checking 'queued' and going to sleep, so none misses this)
+	{ std::lock_guard< std::mutex > guard(sleep_lock); }
+	sleep.notify_one();
+}
+
+//run one job, from the back of this thread's own deque or else from the front of another's:
+static bool run_one() {
+	uint32_t count = uint32_t(deques.size());
+	if (count == 0) return false;
+	uint32_t start = (self < count ? self : 0);
+	Job job;
+	bool found = false;
+	for (uint32_t i = 0; i < count && !found; ++i) {
+		Deque &deque = *deques[(start + i) % count];
+		std::lock_guard< std::mutex > guard(deque.lock);
+		if (deque.jobs.empty()) continue;
+		if (i == 0 && self == start) {
+			job = std::move(deque.jobs.back());
+			deque.jobs.pop_back();
+		} else {
+			job = std::move(deque.jobs.front());
+			deque.jobs.pop_front();
+		}
+		found = true;
+	}
+	if (!found) return false;
+	--queued;
+	execute(job);
+	return true;
+}
+
+static void worker(uint32_t index) {
+	self = index;
+	while (true) {
+		if (run_one()) continue;
+		std::unique_lock< std::mutex > guard(sleep_lock);
+		sleep.wait(guard, [](){ return stopping || queued > 0; });
+		if (stopping && queued == 0) break;
+	}
+}
+
+void init(uint32_t workers) {
+	assert(deques.empty() && "Jobs::init called twice.");
+	if (workers == -1U) {
+		uint32_t cores = std::thread::hardware_concurrency();
+		workers = (cores > 1 ? cores - 1 : 0);
+	}
+	self = 0;
+	stopping = false;
+	for (uint32_t i = 0; i <= workers; ++i) {
+		deques.emplace_back(new Deque());
+	}
+	for (uint32_t i = 1; i <= workers; ++i) {
+		threads.emplace_back(worker, i);
+	}
+}
+
+void shutdown() {
+	//help finish what is queued, then let the workers go:
+	while (run_one()) { }
+	{
+		std::lock_guard< std::mutex > guard(sleep_lock);
+		stopping = true;
+	}
+	sleep.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+	deques.clear();
+	self = -1U;
+}
+
+uint32_t workers() {
+	return uint32_t(threads.size());
+}
+
+void run(std::function< void() > const &run, Counter *counter, Counter *after) {
+	Job job;
+	job.run = run;
+	job.counter = counter;
+	if (counter) ++counter->count;
+	if (after) {
+		std::lock_guard< std::mutex > guard(after->lock);
+		if (after->count != 0) {
+			after->waiting.emplace_back(job);
+			return;
+		}
+	}
+	push(job);
+}
+
+void wait(Counter &counter) {
+	while (counter.count != 0) {
+		if (!run_one()) std::this_thread::yield();
+	}
+	//(finish() may still hold the lock just after lowering the count; wait for it to let go)
+	std::lock_guard< std::mutex > guard(counter.lock);
+}
+
+void parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t begin, uint32_t end) > const &range) {
+	if (grain == 0) grain = 1;
+	if (count <= grain || threads.empty()) {
+		if (count) range(0, count);
+		return;
+	}
+	Counter counter;
+	for (uint32_t begin = grain; begin < count; begin += grain) {
+		uint32_t end = (count - begin > grain ? begin + grain : count);
+		run([&range, begin, end](){ range(begin, end); }, &counter);
+	}
+	range(0, grain);
+	wait(counter);
+}
+
+} //namespace Jobs
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+//A work-stealing job system, shared by everything in the game that wants more than one core.
+//
+// Each thread in the pool (the thread that called init, plus one worker per remaining core) has its own deque of jobs:
+//  jobs a thread starts go on the back of its own deque, and it runs them from the back (most recent first, so still in cache);
+//  a thread with nothing to do steals from the front of another thread's deque (the oldest, and usually largest, work).
+// Waiting for jobs never blocks a pool thread: wait() runs jobs (any jobs) until the ones it is waiting for are done.
+//
+// Before init (and after shutdown) there is no pool, and jobs simply run as soon as they are started.
+
+namespace Jobs {
+
+//start the pool, with 'workers' threads besides the calling one (by default, one per remaining core):
+void init(uint32_t workers = -1U);
+//finish any queued jobs and stop the pool:
+void shutdown();
+//threads in the pool besides the one that called init (zero without a pool):
+uint32_t workers();
+
+struct Counter;
+struct Job {
+	std::function< void() > run;
+	Counter *counter = nullptr; //lowered when the job finishes
+};
+
+//a Counter counts unfinished jobs; wait() for it to reach zero, or start jobs 'after' it:
+struct Counter {
+	std::atomic< uint32_t > count{0};
+	//(internals) jobs held until count reaches zero:
+	std::mutex lock;
+	std::vector< Job > waiting;
+};
+
+//start 'job' on some thread in the pool:
+// 'counter' (if given) counts it until it finishes
+// 'after' (if given) holds the job until that counter reaches zero (e.g., until the jobs it depends on are done)
+void run(std::function< void() > const &job, Counter *counter = nullptr, Counter *after = nullptr);
+
+//run jobs until 'counter' reaches zero:
+// (once it returns, nothing refers to the counter any more, so it may be destroyed)
+void wait(Counter &counter);
+
+//call 'range(begin, end)' over [0,count) in pieces of 'grain' (the last may be shorter), spread across the pool:
+// (the calling thread takes the first piece; counts of no more than 'grain' just run here)
+void parallel_for(uint32_t count, uint32_t grain, std::function< void(uint32_t begin, uint32_t end) > const &range);
+
+} //namespace Jobs
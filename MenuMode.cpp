@@ -103,11 +103,23 @@ bool MenuMode::handle_event(SDL_Event const &e, glm::uvec2 const &window_size) {
 	return false;
 }
 
+void MenuMode::fixed_update(float step) {
+	//the background keeps stepping by FixedStep, just (with a time scale) fewer times:
+	if (background) {
+		background_accumulator += step * background_time_scale;
+		while (background_accumulator >= Mode::FixedStep) {
+			background->fixed_update(Mode::FixedStep);
+			background_accumulator -= Mode::FixedStep;
+		}
+	}
+}
+
 void MenuMode::update(float elapsed) {
 	bounce += elapsed / 0.7f;
 	bounce -= std::floor(bounce);
 
 	if (background) {
+		background->fixed_alpha = glm::clamp((background_accumulator + fixed_alpha * Mode::FixedStep * background_time_scale) / Mode::FixedStep, 0.0f, 1.0f);
 		background->update(elapsed * background_time_scale);
 	}
 }
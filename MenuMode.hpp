@@ -10,6 +10,7 @@ struct MenuMode : public Mode {
 	virtual ~MenuMode() { }
 
 	virtual bool handle_event(SDL_Event const &event, glm::uvec2 const &window_size) override;
+	virtual void fixed_update(float step) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
 
@@ -29,4 +30,5 @@ struct MenuMode : public Mode {
 	std::shared_ptr< Mode > background;
 	float background_time_scale = 1.0f;
 	float background_fade = 0.5f;
+	float background_accumulator = 0.0f; //(scaled time the background's fixed_update hasn't caught up on)
 };
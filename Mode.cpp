@@ -2,6 +2,9 @@
 
 std::shared_ptr< Mode > Mode::current;
 
+constexpr float Mode::FixedStep;
+constexpr uint32_t Mode::MaxFixedSteps;
+
 void Mode::set_current(std::shared_ptr< Mode > const &new_current) {
 	current = new_current;
 	//NOTE: may wish to, e.g., trigger resize events on new current mode.
@@ -14,10 +14,22 @@ public:
 	//The function should return 'true' if it handled the event.
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) { return false; }
 
-	//update is called at the start of a new frame, after events are handled:
+	//fixed_update is called at the start of a new frame, after events are handled,
+	// as many times as it takes for the simulation to catch up with real time (maybe not at all):
+	// 'step' is always FixedStep, so anything simulated here behaves the same at any frame rate
+	virtual void fixed_update(float step) { }
+	static constexpr float FixedStep = 1.0f / 120.0f;
+	//...but at most MaxFixedSteps times per frame (beyond that, the game slows down rather than falling further behind):
+	static constexpr uint32_t MaxFixedSteps = 8;
+
+	//update is called after fixed_update:
 	// 'elapsed' is time in seconds since the last call to 'update'
 	virtual void update(float elapsed) { }
 
+	//how far real time is past the last fixed_update, as a fraction of FixedStep (set before each 'update'):
+	// (blend the last two steps' state by this when drawing, so motion is smooth at any frame rate)
+	float fixed_alpha = 0.0f;
+
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
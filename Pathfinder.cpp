@@ -0,0 +1,210 @@
+#include "Pathfinder.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cassert>
+
+//corridors are cheap to recompute, so rather than tracking which are least used just start over past this many:
+static constexpr const size_t MaxCorridors = 1 << 14;
+
+Pathfinder::Pathfinder(WalkMesh const &walk_mesh_) : walk_mesh(walk_mesh_) {
+	uint32_t count = walk_mesh.triangle_count;
+	blocked_at.assign(count, 0);
+	search_cost.assign(count, 0.0f);
+	search_parent.assign(count, -1U);
+	search_stamp.assign(count, 0);
+	search_closed.assign(count, 0);
+	search_at.assign(count, glm::vec3(0.0f));
+	//every triangle is expanded at most once (see search_closed), pushing at most one entry per edge, plus the start:
+	search_heap.reserve(3 * size_t(count) + 1);
+	funnel_left.reserve(count + 1);
+	funnel_right.reserve(count + 1);
+}
+
+void Pathfinder::set_blocked(uint32_t triangle, bool blocked) {
+	assert(triangle < walk_mesh.triangle_count);
+	if (blocked == is_blocked(triangle)) return;
+	++generation;
+	if (blocked) {
+		blocked_at[triangle] = generation;
+	} else {
+		blocked_at[triangle] = 0;
+		opened_at = generation;
+	}
+}
+
+bool Pathfinder::find_path(WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path_) {
+	assert(path_);
+	auto &path = *path_;
+	path.clear();
+	assert(from.triangle < walk_mesh.triangle_count);
+	assert(to.triangle < walk_mesh.triangle_count);
+
+	glm::vec3 from_point = walk_mesh.world_point(from);
+	glm::vec3 to_point = walk_mesh.world_point(to);
+	if (from.triangle == to.triangle) {
+		path.emplace_back(to_point);
+		return true;
+	}
+
+	Corridor const &found = corridor(from.triangle, from_point, to.triangle, to_point);
+	if (found.triangles.empty()) return false;
+	funnel(found.triangles, from_point, to_point, &path);
+	return true;
+}
+
+Pathfinder::Corridor const &Pathfinder::corridor(uint32_t from, glm::vec3 const &from_point, uint32_t to, glm::vec3 const &to_point) {
+	uint64_t key = (uint64_t(from) << 32) | uint64_t(to);
+	auto f = corridors.find(key);
+	if (f != corridors.end()) {
+		//still good unless something opened up since, or something along it has been blocked since:
+		// (unreachable results only go stale when something opens up)
+		Corridor const &cached = f->second;
+		bool valid = (cached.built_at >= opened_at);
+		for (uint32_t t : cached.triangles) {
+			if (!valid) break;
+			valid = (blocked_at[t] == 0);
+		}
+		if (valid) {
+			++cache_hits;
+			return cached;
+		}
+	}
+
+	if (f == corridors.end() && corridors.size() >= MaxCorridors) corridors.clear();
+	Corridor &result = corridors[key];
+	result.triangles.clear();
+	result.built_at = generation;
+	++searches;
+	if (is_blocked(from) || is_blocked(to)) return result;
+
+	//A* over triangles, entering each at the midpoint of the edge crossed:
+	++search_count;
+	if (search_count == 0) {
+		std::fill(search_stamp.begin(), search_stamp.end(), 0);
+		std::fill(search_closed.begin(), search_closed.end(), 0);
+		search_count = 1;
+	}
+	auto heuristic = [&](uint32_t triangle) {
+		return glm::length(to_point - search_at[triangle]);
+	};
+	auto heap_order = std::greater< std::pair< float, uint32_t > >();
+
+	search_heap.clear();
+	search_stamp[from] = search_count;
+	search_cost[from] = 0.0f;
+	search_parent[from] = -1U;
+	search_at[from] = from_point;
+	search_heap.emplace_back(heuristic(from), from);
+
+	bool found = false;
+	while (!search_heap.empty()) {
+		std::pop_heap(search_heap.begin(), search_heap.end(), heap_order);
+		uint32_t triangle = search_heap.back().second;
+		search_heap.pop_back();
+		if (triangle == to) {
+			found = true;
+			break;
+		}
+		//skip stale heap entries (triangles already expanded):
+		if (search_closed[triangle] == search_count) continue;
+		search_closed[triangle] = search_count;
+
+		glm::uvec3 const &tri = walk_mesh.triangles[triangle];
+		glm::uvec3 const &links = walk_mesh.neighbors[triangle];
+		for (uint32_t e = 0; e < 3; ++e) {
+			if (links[e] == -1U) continue;
+			uint32_t next = links[e] / 3;
+			if (blocked_at[next] != 0 || search_closed[next] == search_count) continue;
+			glm::vec3 at = 0.5f * (walk_mesh.vertices[tri[e]] + walk_mesh.vertices[tri[(e+1)%3]]);
+			float cost = search_cost[triangle] + glm::length(at - search_at[triangle]);
+			if (search_stamp[next] == search_count && search_cost[next] <= cost) continue;
+			search_stamp[next] = search_count;
+			search_cost[next] = cost;
+			search_parent[next] = triangle;
+			search_at[next] = at;
+			search_heap.emplace_back(cost + heuristic(next), next);
+			std::push_heap(search_heap.begin(), search_heap.end(), heap_order);
+		}
+	}
+
+	if (!found) return result;
+
+	for (uint32_t triangle = to; triangle != -1U; triangle = search_parent[triangle]) {
+		result.triangles.emplace_back(triangle);
+	}
+	std::reverse(result.triangles.begin(), result.triangles.end());
+	return result;
+}
+
+void Pathfinder::funnel(std::vector< uint32_t > const &triangles, glm::vec3 const &from_point, glm::vec3 const &to_point, std::vector< glm::vec3 > *path_) {
+	auto &path = *path_;
+
+	//portals (the edges between consecutive triangles, as seen walking along the corridor), from and to the end points:
+	// (triangles are counterclockwise, so leaving through an edge its start is on the right and its end on the left)
+	funnel_left.clear();
+	funnel_right.clear();
+	funnel_left.emplace_back(from_point);
+	funnel_right.emplace_back(from_point);
+	for (uint32_t i = 0; i + 1 < triangles.size(); ++i) {
+		glm::uvec3 const &tri = walk_mesh.triangles[triangles[i]];
+		glm::uvec3 const &links = walk_mesh.neighbors[triangles[i]];
+		uint32_t e = 0;
+		while (e < 3 && (links[e] == -1U || links[e] / 3 != triangles[i+1])) ++e;
+		assert(e < 3);
+		funnel_left.emplace_back(walk_mesh.vertices[tri[(e+1)%3]]);
+		funnel_right.emplace_back(walk_mesh.vertices[tri[e]]);
+	}
+	funnel_left.emplace_back(to_point);
+	funnel_right.emplace_back(to_point);
+
+	//twice the signed area of abc in the floor plane (xy); positive when c is left of a->b:
+	auto cross = [](glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+		return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+	};
+
+	//add a waypoint (corners shared by several portals would otherwise repeat):
+	auto add = [&path, &from_point](glm::vec3 const &point) {
+		if (path.empty() ? point != from_point : point != path.back()) path.emplace_back(point);
+	};
+
+	//narrow a funnel from the current apex through each portal; when one side crosses the other,
+	// the crossed-over corner is a waypoint and becomes the new apex:
+	glm::vec3 apex = from_point, left = from_point, right = from_point;
+	uint32_t left_index = 0, right_index = 0;
+	for (uint32_t i = 1; i < funnel_left.size(); ++i) {
+		glm::vec3 const &l = funnel_left[i];
+		glm::vec3 const &r = funnel_right[i];
+
+		//try to narrow the right side:
+		if (cross(apex, right, r) >= 0.0f) {
+			if (apex == right || cross(apex, left, r) < 0.0f) {
+				right = r;
+				right_index = i;
+			} else {
+				//right crossed over left, so turn the left corner:
+				add(left);
+				apex = right = left;
+				right_index = i = left_index;
+				continue;
+			}
+		}
+
+		//try to narrow the left side:
+		if (cross(apex, left, l) <= 0.0f) {
+			if (apex == left || cross(apex, right, l) > 0.0f) {
+				left = l;
+				left_index = i;
+			} else {
+				//left crossed over right, so turn the right corner:
+				add(right);
+				apex = left = right;
+				left_index = i = right_index;
+				continue;
+			}
+		}
+	}
+	add(to_point);
+	if (path.empty()) path.emplace_back(to_point); //(to_point == from_point)
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "WalkMesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+//"Pathfinder" finds paths for agents that walk on a WalkMesh.
+// It runs A* over the mesh's triangles (crossing edges at their midpoints) to find a corridor,
+// then pulls the corridor tight (the "simple stupid funnel" algorithm) into a list of waypoints.
+// Corridors are cached per (start triangle, goal triangle), so agents that re-path often
+// (e.g., every second, toward a moving player) usually only pay for the funnel.
+
+struct Pathfinder {
+	Pathfinder(WalkMesh const &walk_mesh);
+
+	WalkMesh const &walk_mesh;
+
+	//find a path from 'from' to 'to' as waypoints to walk toward in order (the last is 'to' itself):
+	// returns false (and leaves 'path' empty) if 'to' can't be reached.
+	// (re-uses the storage in 'path', so re-pathing into the same vector doesn't allocate)
+	bool find_path(WalkMesh::WalkPoint const &from, WalkMesh::WalkPoint const &to, std::vector< glm::vec3 > *path);
+
+	//blocked triangles (e.g., a closed door) are kept out of paths:
+	// blocking only drops cached corridors through the triangle; unblocking drops them all (any might now be shorter).
+	void set_blocked(uint32_t triangle, bool blocked);
+	bool is_blocked(uint32_t triangle) const { return blocked_at[triangle] != 0; }
+
+	//counters (e.g., for a debug overlay):
+	uint32_t searches = 0; //corridors found with A*
+	uint32_t cache_hits = 0; //corridors found in the cache
+
+	//------ internals ------
+
+	//cached corridors, keyed by (start triangle, goal triangle):
+	struct Corridor {
+		std::vector< uint32_t > triangles; //start to goal; empty if the goal wasn't reachable
+		uint32_t built_at = 0; //generation when searched
+	};
+	std::unordered_map< uint64_t, Corridor > corridors;
+	Corridor const &corridor(uint32_t from, glm::vec3 const &from_point, uint32_t to, glm::vec3 const &to_point);
+
+	uint32_t generation = 1; //advanced by every set_blocked
+	uint32_t opened_at = 0; //generation when a triangle was last unblocked
+	std::vector< uint32_t > blocked_at; //generation when each triangle was blocked, or 0 if it isn't
+
+	//pull a corridor tight into waypoints:
+	void funnel(std::vector< uint32_t > const &triangles, glm::vec3 const &from_point, glm::vec3 const &to_point, std::vector< glm::vec3 > *path);
+
+	//pooled A* search state (re-used between searches, so a search doesn't allocate):
+	std::vector< float > search_cost;
+	std::vector< uint32_t > search_parent;
+	std::vector< uint32_t > search_stamp; //search that last touched a triangle
+	std::vector< uint32_t > search_closed; //search that last expanded a triangle (each is expanded at most once, which bounds search_heap)
+	std::vector< glm::vec3 > search_at; //where the path enters each triangle
+	uint32_t search_count = 0;
+	std::vector< std::pair< float, uint32_t > > search_heap;
+	std::vector< glm::vec3 > funnel_left, funnel_right; //portals along a corridor
+};
@@ -1,8 +1,13 @@
 #include "Scene.hpp"
+#include "SoundPropagation.hpp"
+#include "Jobs.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iostream>
 
 glm::mat4 Scene::Transform::make_local_to_parent() const {
@@ -159,23 +164,63 @@ void Scene::delete_camera(Scene::Camera *object) {
 	list_delete< Scene::Camera >(object);
 }
 
+Scene::SoundEmitter *Scene::new_sound_emitter(Scene::Transform *transform, std::shared_ptr< Sound::PlayingSample > const &sample) {
+	assert(transform && "Scene::SoundEmitter must be attached to a transform.");
+	return list_new< Scene::SoundEmitter >(first_sound_emitter, transform, sample);
+}
+
+void Scene::delete_sound_emitter(Scene::SoundEmitter *emitter) {
+	list_delete< Scene::SoundEmitter >(emitter);
+}
+
+Scene::Collider *Scene::new_collider(Scene::Transform *transform) {
+	assert(transform && "Scene::Collider must be attached to a transform.");
+	return list_new< Scene::Collider >(first_collider, transform);
+}
+
+void Scene::delete_collider(Scene::Collider *collider) {
+	//forget its contacts, so nothing points at it:
+	auto involves = [collider](std::pair< Collider *, Collider * > const &pair) {
+		return pair.first == collider || pair.second == collider;
+	};
+	touching.erase(std::remove_if(touching.begin(), touching.end(), involves), touching.end());
+	contacts.erase(std::remove_if(contacts.begin(), contacts.end(), [collider](Contact const &contact) {
+		return contact.a == collider || contact.b == collider;
+	}), contacts.end());
+	list_delete< Scene::Collider >(collider);
+}
+
 void Scene::draw(Scene::Camera const *camera) {
 	assert(camera && "Must have a camera to draw scene from.");
 
 	glm::mat4 world_to_camera = camera->transform->make_world_to_local();
 	glm::mat4 world_to_clip = camera->make_projection() * world_to_camera;
 
+	draw_objects.clear();
 	for (Scene::Object *object = first_object; object != nullptr; object = object->alloc_next) {
-		glm::mat4 local_to_world = object->transform->make_local_to_world();
+		draw_objects.emplace_back(object);
+	}
+	draw_matrices.resize(draw_objects.size());
+	Jobs::parallel_for(uint32_t(draw_objects.size()), 256, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			glm::mat4 local_to_world = draw_objects[i]->transform->make_local_to_world();
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+			//compute modelview+projection (object space to clip space) matrix for this object:
+			draw_matrices[i].mvp = world_to_clip * local_to_world;
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = local_to_world;
+			//compute modelview (object space to camera local space) matrix for this object:
+			draw_matrices[i].mv = local_to_world;
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+			//NOTE: inverse cancels out transpose unless there is scale involved
+			draw_matrices[i].itmv = glm::inverse(glm::transpose(glm::mat3(local_to_world)));
+		}
+	});
+
+	for (uint32_t i = 0; i < draw_objects.size(); ++i) {
+		Scene::Object *object = draw_objects[i];
+		glm::mat4 const &mvp = draw_matrices[i].mvp;
+		glm::mat4 const &mv = draw_matrices[i].mv;
+		glm::mat3 const &itmv = draw_matrices[i].itmv;
 
 		//set up program uniforms:
 		glUseProgram(object->program);
@@ -199,7 +244,158 @@ void Scene::draw(Scene::Camera const *camera) {
 }
 
 
+void Scene::update_sound_emitters(float ramp) {
+	sound_emitter_updates.clear();
+	for (Scene::SoundEmitter *emitter = first_sound_emitter; emitter != nullptr; emitter = emitter->alloc_next) {
+		if (!emitter->sample) continue;
+		glm::vec3 position = glm::vec3(emitter->transform->make_local_to_world() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+		if (sound_propagation) position = sound_propagation->apparent_position(position);
+		//skip emitters that haven't moved (or changed samples) since the last update:
+		if (position == emitter->sent_position && emitter->sample.get() == emitter->sent_sample) continue;
+		emitter->sent_position = position;
+		emitter->sent_sample = emitter->sample.get();
+		sound_emitter_updates.emplace_back(emitter->sample.get(), position);
+	}
+	if (!sound_emitter_updates.empty()) {
+		Sound::set_positions(sound_emitter_updates, ramp);
+	}
+}
+
+//exact tests between world-space shapes (boxes are taken to be unskewed, as they are without non-uniform scale under rotation):
+static bool sphere_sphere(Scene::ColliderBounds const &a, Scene::ColliderBounds const &b) {
+	float radius = a.axes[0].x + b.axes[0].x;
+	glm::vec3 to = b.center - a.center;
+	return glm::dot(to, to) <= radius * radius;
+}
+
+static bool box_sphere(Scene::ColliderBounds const &box, Scene::ColliderBounds const &sphere) {
+	//closest point of the box to the sphere's center:
+	glm::vec3 to = sphere.center - box.center;
+	glm::vec3 closest = box.center;
+	for (uint32_t i = 0; i < 3; ++i) {
+		float length = glm::length(box.axes[i]);
+		if (length == 0.0f) continue;
+		glm::vec3 along = box.axes[i] / length;
+		closest += glm::clamp(glm::dot(to, along), -length, length) * along;
+	}
+	glm::vec3 gap = sphere.center - closest;
+	return glm::dot(gap, gap) <= sphere.axes[0].x * sphere.axes[0].x;
+}
+
+static bool box_box(Scene::ColliderBounds const &a, Scene::ColliderBounds const &b) {
+	//separating axis test: boxes touch unless some face normal or edge-edge cross product separates them:
+	glm::vec3 to = b.center - a.center;
+	auto separates = [&](glm::vec3 const &axis) {
+		if (glm::dot(axis, axis) < 1e-12f) return false; //(parallel edges; covered by the face normals)
+		float extent = 0.0f;
+		for (uint32_t i = 0; i < 3; ++i) {
+			extent += std::abs(glm::dot(a.axes[i], axis)) + std::abs(glm::dot(b.axes[i], axis));
+		}
+		return std::abs(glm::dot(to, axis)) > extent;
+	};
+	for (uint32_t i = 0; i < 3; ++i) {
+		if (separates(glm::cross(a.axes[(i+1)%3], a.axes[(i+2)%3]))) return false;
+		if (separates(glm::cross(b.axes[(i+1)%3], b.axes[(i+2)%3]))) return false;
+	}
+	for (uint32_t i = 0; i < 3; ++i) {
+		for (uint32_t j = 0; j < 3; ++j) {
+			if (separates(glm::cross(a.axes[i], b.axes[j]))) return false;
+		}
+	}
+	return true;
+}
+
+void Scene::update_collisions() {
+	//world-space shapes and bounding boxes:
+	collider_bounds.clear();
+	for (Scene::Collider *collider = first_collider; collider != nullptr; collider = collider->alloc_next) {
+		collider_bounds.emplace_back();
+		collider_bounds.back().collider = collider;
+	}
+	Jobs::parallel_for(uint32_t(collider_bounds.size()), 256, [this](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			ColliderBounds &bounds = collider_bounds[i];
+			Scene::Collider const *collider = bounds.collider;
+			glm::mat4 local_to_world = collider->transform->make_local_to_world();
+			bounds.center = glm::vec3(local_to_world * glm::vec4(collider->center, 1.0f));
+			glm::vec3 half;
+			if (collider->shape == Collider::Sphere) {
+				float scale = std::max(glm::length(glm::vec3(local_to_world[0])), std::max(glm::length(glm::vec3(local_to_world[1])), glm::length(glm::vec3(local_to_world[2]))));
+				bounds.axes = glm::mat3(collider->radius.x * scale);
+				half = glm::vec3(collider->radius.x * scale);
+			} else {
+				for (uint32_t a = 0; a < 3; ++a) {
+					bounds.axes[a] = glm::vec3(local_to_world[a]) * collider->radius[a];
+				}
+				half = glm::abs(bounds.axes[0]) + glm::abs(bounds.axes[1]) + glm::abs(bounds.axes[2]);
+			}
+			bounds.min = bounds.center - half;
+			bounds.max = bounds.center + half;
+		}
+	});
+
+	//sweep-and-prune: sorted by min.x, each box only needs checking against those that start before it ends:
+	std::sort(collider_bounds.begin(), collider_bounds.end(), [](ColliderBounds const &a, ColliderBounds const &b) {
+		return a.min.x < b.min.x;
+	});
+	std::less< Collider * > before;
+	touching.swap(was_touching);
+	touching.clear();
+	for (auto a = collider_bounds.begin(); a != collider_bounds.end(); ++a) {
+		for (auto b = a + 1; b != collider_bounds.end() && b->min.x <= a->max.x; ++b) {
+			if (b->min.y > a->max.y || a->min.y > b->max.y) continue;
+			if (b->min.z > a->max.z || a->min.z > b->max.z) continue;
+			if (!(a->collider->layer & b->collider->mask) || !(b->collider->layer & a->collider->mask)) continue;
+			bool touch;
+			if (a->collider->shape == Collider::Sphere) {
+				touch = (b->collider->shape == Collider::Sphere ? sphere_sphere(*a, *b) : box_sphere(*b, *a));
+			} else {
+				touch = (b->collider->shape == Collider::Sphere ? box_sphere(*a, *b) : box_box(*a, *b));
+			}
+			if (!touch) continue;
+			if (before(a->collider, b->collider)) touching.emplace_back(a->collider, b->collider);
+			else touching.emplace_back(b->collider, a->collider);
+		}
+	}
+
+	//compare with the last update's (sorted) pairs to find what started and stopped:
+	auto pair_before = [&before](std::pair< Collider *, Collider * > const &x, std::pair< Collider *, Collider * > const &y) {
+		return before(x.first, y.first) || (x.first == y.first && before(x.second, y.second));
+	};
+	std::sort(touching.begin(), touching.end(), pair_before);
+	contacts.clear();
+	auto now = touching.begin();
+	auto was = was_touching.begin();
+	while (now != touching.end() || was != was_touching.end()) {
+		Contact contact;
+		if (was == was_touching.end() || (now != touching.end() && pair_before(*now, *was))) {
+			contact.event = Contact::Enter;
+			contact.a = now->first;
+			contact.b = now->second;
+			++now;
+		} else if (now == touching.end() || pair_before(*was, *now)) {
+			contact.event = Contact::Exit;
+			contact.a = was->first;
+			contact.b = was->second;
+			++was;
+		} else {
+			contact.event = Contact::Stay;
+			contact.a = now->first;
+			contact.b = now->second;
+			++now;
+			++was;
+		}
+		contacts.emplace_back(contact);
+	}
+}
+
 Scene::~Scene() {
+	while (first_collider) {
+		delete_collider(first_collider);
+	}
+	while (first_sound_emitter) {
+		delete_sound_emitter(first_sound_emitter);
+	}
 	while (first_camera) {
 		delete_camera(first_camera);
 	}
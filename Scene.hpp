@@ -1,6 +1,7 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Sound.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -8,6 +9,9 @@
 #include <vector>
 #include <list>
 #include <functional>
+#include <limits>
+
+struct SoundPropagation;
 
 //"Scene" manages a hierarchy of transformations with, potentially, attached information.
 struct Scene {
@@ -100,6 +104,48 @@ struct Scene {
 		Camera *alloc_next = nullptr;
 	};
 
+	//"SoundEmitter"s keep a playing sample positioned at a transform:
+	struct SoundEmitter {
+		Transform *transform; //emitters must be attached to transforms.
+		SoundEmitter(Transform *transform_, std::shared_ptr< Sound::PlayingSample > const &sample_) : transform(transform_), sample(sample_) {
+			assert(transform);
+		}
+
+		//sample to position (may be changed or set to null at any time):
+		std::shared_ptr< Sound::PlayingSample > sample;
+
+		//world position last sent to the mixer (used to skip emitters that haven't moved):
+		glm::vec3 sent_position = glm::vec3(std::numeric_limits< float >::quiet_NaN());
+		Sound::PlayingSample const *sent_sample = nullptr;
+
+		//used by Scene to manage allocation:
+		SoundEmitter **alloc_prev_next = nullptr;
+		SoundEmitter *alloc_next = nullptr;
+	};
+
+	//"Collider"s give a transform a solid shape, so the scene can report what touches what:
+	struct Collider {
+		Transform *transform; //colliders must be attached to transforms.
+		Collider(Transform *transform_) : transform(transform_) {
+			assert(transform);
+		}
+
+		//shape, in the transform's local space (so it moves, turns, and scales with the transform):
+		enum Shape : uint8_t {
+			Box, //'radius' gives half the size along each axis
+			Sphere, //'radius.x' is the radius (scaled by the transform's largest scale)
+		} shape = Box;
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 radius = glm::vec3(0.5f);
+		//two colliders are only tested if each one's layer is in the other's mask:
+		uint32_t layer = 1;
+		uint32_t mask = -1U;
+
+		//used by Scene to manage allocation:
+		Collider **alloc_prev_next = nullptr;
+		Collider *alloc_next = nullptr;
+	};
+
 	//------ functions to create / destroy scene things -----
 	//NOTE: all scene objects are automatically freed when scene is deallocated
 
@@ -118,17 +164,74 @@ struct Scene {
 	//Delete a camera:
 	void delete_camera(Camera *);
 
+	//Create a new sound emitter attached to a transform:
+	SoundEmitter *new_sound_emitter(Transform *transform, std::shared_ptr< Sound::PlayingSample > const &sample = nullptr);
+	//Delete a sound emitter: (NOTE: does not stop its sample)
+	void delete_sound_emitter(SoundEmitter *);
+
+	//Create a new collider attached to a transform:
+	Collider *new_collider(Transform *transform);
+	//Delete a collider: (NOTE: its current contacts are forgotten, without Exit events)
+	void delete_collider(Collider *);
+
 	//used to manage allocated objects:
 	Transform *first_transform = nullptr;
 	Object *first_object = nullptr;
 	Camera *first_camera = nullptr;
+	SoundEmitter *first_sound_emitter = nullptr;
+	Collider *first_collider = nullptr;
 	//(you shouldn't be manipulating these pointers directly
 
 	//------ functions to traverse the scene ------
 
 	//Draw the scene from a given camera by computing appropriate matrices and sending all objects to OpenGL:
 	//"camera" must be non-null!
+	//(each object's matrices are computed first, split across the job pool, then objects are drawn in order)
 	void draw(Camera const *camera);
+	struct DrawMatrices {
+		glm::mat4 mvp; //object to clip
+		glm::mat4 mv; //object to light
+		glm::mat3 itmv; //normal to light
+	};
+	std::vector< Object * > draw_objects; //(re-used between calls to avoid allocation)
+	std::vector< DrawMatrices > draw_matrices;
+
+	//Send the world positions of all sound emitters that moved to the mixer, as a single batch:
+	// (call once per frame, after transforms have been updated)
+	void update_sound_emitters(float ramp = 1.0f / 60.0f);
+	std::vector< Sound::PositionUpdate > sound_emitter_updates; //(re-used between calls to avoid allocation)
+	//if set, emitters are placed where they would be heard around walls:
+	// (set the propagation's listener before calling update_sound_emitters)
+	SoundPropagation *sound_propagation = nullptr;
+
+	//Find which colliders touch, and how that changed since the last call:
+	// (call once per simulation step, after transforms have been updated)
+	//Candidates come from sweep-and-prune over world bounding boxes (sorted along x, then swept),
+	// so the cost is O(n log n) plus the number of nearly-touching pairs, and each candidate is tested exactly.
+	//(world shapes are computed by the job pool)
+	void update_collisions();
+	struct Contact {
+		enum Event : uint8_t {
+			Enter, //started touching this update
+			Stay, //touched last update too
+			Exit, //stopped touching this update
+		} event;
+		Collider *a, *b;
+		//does this contact involve colliders 'x' and 'y' (either way around)?
+		bool between(Collider const *x, Collider const *y) const {
+			return (a == x && b == y) || (a == y && b == x);
+		}
+	};
+	std::vector< Contact > contacts; //(from the last update_collisions)
+	//pairs touching as of the last update_collisions (sorted), and scratch space for finding them:
+	std::vector< std::pair< Collider *, Collider * > > touching, was_touching;
+	struct ColliderBounds {
+		Collider *collider;
+		glm::vec3 min, max; //world-space bounding box
+		glm::vec3 center; //world-space center
+		glm::mat3 axes; //world-space half-size vectors of a box (or, for a sphere, axes[0].x is the radius)
+	};
+	std::vector< ColliderBounds > collider_bounds;
 
 
 	~Scene(); //destructor deallocates transforms, objects, cameras
@@ -1,11 +1,26 @@
 #include "Sound.hpp"
 
+#include "mapped_file.hpp"
+#include "fft.hpp"
+#include "read_chunk.hpp"
+#include "realtime_check.hpp"
+
 #include <SDL.h>
 
 #include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <list>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
 
 namespace Sound {
 
@@ -15,28 +30,27 @@ struct Listener listener;
 namespace {
 //local functions + data:
 
-//helpers for advancing ramps:
-constexpr const float RampStep = float(MixSamples) / float(AudioRate);
-void step_position_ramp(Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RampStep) {
+//helpers for advancing ramps by 'step' seconds:
+void step_position_ramp(Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RampStep / ramp.ramp);
-		ramp.ramp -= RampStep;
+		ramp.value = glm::mix(ramp.value, ramp.target, step / ramp.ramp);
+		ramp.ramp -= step;
 	}
 }
-void step_value_ramp(Ramp< float > &ramp) {
-	if (ramp.ramp < RampStep) {
+void step_value_ramp(Ramp< float > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RampStep / ramp.ramp);
-		ramp.ramp -= RampStep;
+		ramp.value = glm::mix(ramp.value, ramp.target, step / ramp.ramp);
+		ramp.ramp -= step;
 	}
 }
-void step_direction_ramp(Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RampStep) {
+void step_direction_ramp(Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -60,10 +74,10 @@ void step_direction_ramp(Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RampStep) / ramp.ramp;
+		angle *= (ramp.ramp - step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RampStep;
+		ramp.ramp -= step;
 	}
 }
 
@@ -100,107 +114,1127 @@ void compute_pan_from_listener_and_position(
 
 //list of all currently playing samples:
 std::list< std::shared_ptr< PlayingSample > > playing_samples;
+//samples the mixer has finished with; the mixer moves them here (which doesn't allocate or free)
+// and unlock() frees them later, outside the audio thread:
+std::list< std::shared_ptr< PlayingSample > > finished_samples;
 
-void mix_audio(void *, Uint8 *stream, int len) {
-	assert(stream); //should always have some audio buffer
+//mixer performance statistics (see Sound::stats()):
+constexpr const uint32_t StatsWindow = 128; //number of recent blocks 'worst' values are computed over
+struct {
+	uint64_t blocks = 0;
+	uint32_t xruns = 0;
+	float peak = 0.0f;
+	std::chrono::steady_clock::time_point last_start;
+	//per-block history, indexed by block % StatsWindow:
+	float mix_ms[StatsWindow];
+	float gap_ms[StatsWindow];
+	float budget_ms[StatsWindow];
+	uint32_t voices[StatsWindow];
+	bool xrun[StatsWindow];
+} mixer_stats;
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MixSamples * sizeof(LR)); //should always have the expected number of samples
+struct LR {
+	float l;
+	float r;
+};
+static_assert(sizeof(LR) == 8, "Sample is packed");
 
-	LR *buffer = reinterpret_cast< LR * >(stream);
+//per-voice gains: left and right output, plus reverb send:
+struct Gains {
+	float l;
+	float r;
+	float send;
+};
 
-	//zero the output buffer:
-	for (uint32_t s = 0; s < MixSamples; ++s) {
-		buffer[s].l = 0.0f;
-		buffer[s].r = 0.0f;
+//the mixer works through its output in chunks of (at most) ChunkSamples, and
+// each chunk in sub-blocks of (at most) RampSamples, updating ramps and panning
+// between sub-blocks; this way the device can ask for blocks of any size:
+constexpr const uint32_t ChunkSamples = 1024;
+constexpr const uint32_t ChunkSubBlocks = ChunkSamples / RampSamples;
+static_assert(ChunkSamples % RampSamples == 0, "chunks are made of whole sub-blocks");
+
+//listener state at a sub-block boundary:
+struct ListenerState {
+	glm::vec3 position;
+	glm::vec3 right;
+	glm::vec3 up;
+	float volume;
+};
+
+//mixer clock: number of samples mixed so far (see Sound::now()):
+uint64_t mixer_time = 0;
+
+//reverb zones run feedback delay networks: ReverbLines delay lines whose outputs are
+// damped, mixed together by a (Hadamard) matrix, and fed back in along with the zone's send.
+//Every line is at least RampSamples long, so a whole sub-block of line output is already
+// written when it is needed, and each stage below is a straight loop over the sub-block:
+constexpr const uint32_t ReverbLines = 8;
+constexpr const uint32_t ReverbLineSize = 8192; //longest possible line (power of two; about 170ms)
+struct ReverbZone {
+	bool active = false;
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+	float send = 0.0f; //level sent by samples playing in the zone
+	float wet = 0.0f; //level of the reverb's output
+	float damping = 0.0f; //lowpass in the feedback path (higher is darker)
+	uint32_t length[ReverbLines] = {}; //line lengths, in samples
+	float gain[ReverbLines] = {}; //feedback gain per line (sets the decay time)
+	float damp_state[ReverbLines] = {};
+	uint32_t write = 0; //write position, shared by all lines
+	std::vector< float > lines; //ReverbLines lines of ReverbLineSize samples each
+};
+ReverbZone reverb_zones[MaxReverbZones];
+
+//zone containing a position, or -1U if none does:
+uint32_t reverb_zone_at(glm::vec3 const &position) {
+	for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+		ReverbZone const &zone = reverb_zones[z];
+		if (zone.active
+		 && position.x >= zone.min.x && position.y >= zone.min.y && position.z >= zone.min.z
+		 && position.x <= zone.max.x && position.y <= zone.max.y && position.z <= zone.max.z) {
+			return z;
+		}
 	}
-	
-	//Figure out global info (listener position, volume) at start and end of mix period:
-	glm::vec3 start_position = listener.position.value;
-	glm::vec3 start_right = listener.right.value;
-	float start_volume = volume.value;
+	return -1U;
+}
 
-	step_position_ramp(listener.position);
-	step_direction_ramp(listener.right);
-	step_value_ramp(volume);
+//run a zone's reverb over one sub-block of its send, adding the (stereo) output to 'out':
+void run_reverb(ReverbZone &zone, float const *send, LR *out, uint32_t frames) {
+	assert(frames <= RampSamples);
+	constexpr const uint32_t Mask = ReverbLineSize - 1;
+	float tap[ReverbLines][RampSamples];
 
-	glm::vec3 end_position = listener.position.value;
-	glm::vec3 end_right = listener.right.value;
-	float end_volume = volume.value;
+	//read line outputs:
+	for (uint32_t k = 0; k < ReverbLines; ++k) {
+		float const *line = zone.lines.data() + k * ReverbLineSize;
+		uint32_t at = (zone.write - zone.length[k]) & Mask;
+		uint32_t first = std::min(frames, ReverbLineSize - at);
+		std::copy(line + at, line + at + first, tap[k]);
+		std::copy(line, line + (frames - first), tap[k] + first);
+	}
 
-	//now add audio for each playing sample:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		PlayingSample &source = **si; //iterator over shared pointers
+	//damp and decay: the lowpass is recursive in time, so this loop runs across lines instead:
+	float keep = zone.damping, take = 1.0f - zone.damping;
+	float state[ReverbLines];
+	for (uint32_t k = 0; k < ReverbLines; ++k) {
+		state[k] = zone.damp_state[k];
+	}
+	for (uint32_t s = 0; s < frames; ++s) {
+		for (uint32_t k = 0; k < ReverbLines; ++k) {
+			state[k] = keep * state[k] + take * tap[k][s];
+			tap[k][s] = zone.gain[k] * state[k];
+		}
+	}
+	for (uint32_t k = 0; k < ReverbLines; ++k) {
+		//(flush decayed tails to zero rather than letting them linger as slow denormals)
+		zone.damp_state[k] = (std::abs(state[k]) < 1e-20f ? 0.0f : state[k]);
+	}
+
+	//even lines go to the left, odd lines to the right:
+	float wet = zone.wet;
+	for (uint32_t s = 0; s < frames; ++s) {
+		out[s].l += wet * (tap[0][s] + tap[2][s] + tap[4][s] + tap[6][s]);
+		out[s].r += wet * (tap[1][s] + tap[3][s] + tap[5][s] + tap[7][s]);
+	}
+
+	//mix lines with a Hadamard matrix (as butterflies; normalized when written back):
+	for (uint32_t h = 1; h < ReverbLines; h *= 2) {
+		for (uint32_t k = 0; k < ReverbLines; k += 2 * h) {
+			for (uint32_t j = k; j < k + h; ++j) {
+				float *a = tap[j], *b = tap[j + h];
+				for (uint32_t s = 0; s < frames; ++s) {
+					float sum = a[s] + b[s];
+					float difference = a[s] - b[s];
+					a[s] = sum;
+					b[s] = difference;
+				}
+			}
+		}
+	}
+
+	//write feedback plus send (with alternating signs, so lines start out decorrelated):
+	float const norm = 1.0f / std::sqrt(float(ReverbLines));
+	uint32_t at = zone.write & Mask;
+	uint32_t first = std::min(frames, ReverbLineSize - at);
+	for (uint32_t k = 0; k < ReverbLines; ++k) {
+		float *line = zone.lines.data() + k * ReverbLineSize;
+		float sign = (k % 2 ? -1.0f : 1.0f);
+		float const *feedback = tap[k];
+		for (uint32_t s = 0; s < first; ++s) {
+			line[at + s] = norm * feedback[s] + sign * send[s];
+		}
+		for (uint32_t s = first; s < frames; ++s) {
+			line[s - first] = norm * feedback[s] + sign * send[s];
+		}
+	}
+	zone.write = (zone.write + frames) & Mask;
+}
+
+//HRTF rendering uses uniformly partitioned overlap-save convolution: impulse responses are
+// split into HRTFBlock-sample partitions, each transformed once at load time; each voice
+// transforms each block of its input once and keeps the spectra of the most recent blocks
+// (a "frequency-domain delay line"), so a block of output costs one multiply-add per
+// partition per bin, plus one (shared, stereo) inverse transform:
+constexpr const uint32_t HRTFBlock = RampSamples;
+constexpr const uint32_t HRTFSize = 2 * HRTFBlock; //transform size
+constexpr const uint32_t HRTFBins = HRTFBlock + 1; //bins kept (input is real, so the rest are conjugates)
+FFTPlan const hrtf_fft(HRTFSize); //shared by every voice
+
+struct HRTFSet {
+	std::vector< glm::vec3 > directions;
+	uint32_t partitions = 0;
+	uint32_t generation = 0; //which enable_hrtf installed this set (voices remember it, so they never use another set's directions)
+	//response spectra, indexed by ((direction * 2 + ear) * partitions + partition) * HRTFBins + bin:
+	std::vector< std::complex< float > > spectra;
+	std::complex< float > const *response(uint32_t direction, uint32_t ear, uint32_t partition) const {
+		return spectra.data() + ((direction * 2 + ear) * partitions + partition) * HRTFBins;
+	}
+
+	//nearest direction for each cell of an azimuth/elevation grid (so lookups don't search):
+	static constexpr const uint32_t Azimuths = 72; //5 degree cells
+	static constexpr const uint32_t Elevations = 37;
+	std::vector< uint32_t > nearest_table;
+	uint32_t nearest(glm::vec3 const &dir) const {
+		float azimuth = std::atan2(dir.x, dir.y); //0 is straight ahead, positive is to the right
+		float elevation = std::asin(glm::clamp(dir.z, -1.0f, 1.0f));
+		uint32_t a = uint32_t(std::floor((azimuth / (2.0f * 3.1415926f) + 0.5f) * Azimuths + 0.5f)) % Azimuths;
+		uint32_t e = uint32_t(glm::clamp((elevation / 3.1415926f + 0.5f) * (Elevations - 1) + 0.5f, 0.0f, float(Elevations - 1)));
+		return nearest_table[e * Azimuths + a];
+	}
+
+	//transform responses ('taps' per ear, left then right for each direction) into partitioned spectra:
+	HRTFSet(std::vector< glm::vec3 > const &directions_, std::vector< float > const &data) : directions(directions_) {
+		if (directions.empty() || data.size() % (2 * directions.size()) != 0) {
+			throw std::runtime_error("HRTF data isn't a whole number of taps for each direction and ear.");
+		}
+		for (auto &d : directions) {
+			if (d == glm::vec3(0.0f)) throw std::runtime_error("HRTF direction is zero.");
+			d = glm::normalize(d);
+		}
+		uint32_t taps = uint32_t(data.size() / (2 * directions.size()));
+		partitions = std::max(1U, (taps + HRTFBlock - 1) / HRTFBlock);
+		spectra.resize(directions.size() * 2 * partitions * HRTFBins);
+
+		float temp[HRTFSize];
+		for (uint32_t d = 0; d < directions.size(); ++d) {
+			for (uint32_t ear = 0; ear < 2; ++ear) {
+				float const *ir = data.data() + (d * 2 + ear) * taps;
+				for (uint32_t p = 0; p < partitions; ++p) {
+					//partition goes in the first half of the transform, zeros in the second (for overlap-save):
+					for (uint32_t i = 0; i < HRTFSize; ++i) {
+						uint32_t t = p * HRTFBlock + i;
+						temp[i] = (i < HRTFBlock && t < taps ? ir[t] : 0.0f);
+					}
+					hrtf_fft.forward_real(temp, spectra.data() + ((d * 2 + ear) * partitions + p) * HRTFBins);
+				}
+			}
+		}
+
+		nearest_table.resize(Azimuths * Elevations);
+		for (uint32_t e = 0; e < Elevations; ++e) {
+			float elevation = (e / float(Elevations - 1) - 0.5f) * 3.1415926f;
+			for (uint32_t a = 0; a < Azimuths; ++a) {
+				float azimuth = (a / float(Azimuths) - 0.5f) * 2.0f * 3.1415926f;
+				glm::vec3 dir(std::sin(azimuth) * std::cos(elevation), std::cos(azimuth) * std::cos(elevation), std::sin(elevation));
+				uint32_t best = 0;
+				for (uint32_t d = 1; d < directions.size(); ++d) {
+					if (glm::dot(directions[d], dir) > glm::dot(directions[best], dir)) best = d;
+				}
+				nearest_table[e * Azimuths + a] = best;
+			}
+		}
+	}
+};
+std::unique_ptr< HRTFSet > hrtf_set; //(only set or cleared while locked)
+uint32_t hrtf_generation = 0; //bumped (while locked) by every enable_hrtf and disable_hrtf
+
+//responses for a rigid spherical head: delay and shadowing between the ears, a little
+// darkening behind, and an elevation-dependent "pinna" echo. Not anyone's actual ears,
+// but enough to hear left/right, front/back, and up/down apart:
+HRTFSet *make_spherical_head_hrtf() {
+	constexpr const uint32_t Taps = 128;
+	std::vector< glm::vec3 > directions;
+	std::vector< float > data;
+	for (int32_t elevation = -40; elevation <= 90; elevation += 10) {
+		uint32_t steps = (elevation == 90 ? 1 : 36);
+		for (uint32_t step = 0; step < steps; ++step) {
+			float az = glm::radians(step * 10.0f), el = glm::radians(float(elevation));
+			glm::vec3 dir(std::sin(az) * std::cos(el), std::cos(az) * std::cos(el), std::sin(el));
+			directions.emplace_back(dir);
+
+			//Woodworth's interaural time difference (head radius 8.75cm, sound at 343m/s):
+			float lateral = std::asin(glm::clamp(dir.x, -1.0f, 1.0f));
+			float itd = 0.0875f / 343.0f * (std::abs(lateral) + std::sin(std::abs(lateral))) * AudioRate;
+			//pinna echo arrives sooner for sounds from above:
+			float pinna = 2.0f + 6.0f * (1.0f - (dir.z + 1.0f) * 0.5f);
+
+			for (uint32_t ear = 0; ear < 2; ++ear) {
+				float side = (ear == 0 ? -dir.x : dir.x); //how much the source is on this ear's side
+				float delay = 8.0f + (side < 0.0f ? itd : 0.0f);
+				float gain = 1.0f + 0.25f * side;
+				float pole = glm::clamp(0.6f * std::max(0.0f, -side) + 0.3f * std::max(0.0f, -dir.y), 0.0f, 0.9f);
+
+				std::vector< float > ir(Taps, 0.0f);
+				//windowed-sinc fractional delays:
+				auto add_impulse = [&ir](float at, float amount) {
+					for (int32_t t = int32_t(at) - 8; t <= int32_t(at) + 8; ++t) {
+						if (t < 0 || t >= int32_t(Taps)) continue;
+						float x = t - at;
+						float sinc = (std::abs(x) < 1e-6f ? 1.0f : std::sin(3.1415926f * x) / (3.1415926f * x));
+						float window = 0.5f + 0.5f * std::cos(3.1415926f * glm::clamp(x / 9.0f, -1.0f, 1.0f));
+						ir[t] += amount * sinc * window;
+					}
+				};
+				add_impulse(delay, gain);
+				add_impulse(delay + pinna, -0.4f * gain);
+				//head shadow (one-pole lowpass):
+				float state = 0.0f;
+				for (auto &v : ir) {
+					state = pole * state + (1.0f - pole) * v;
+					v = state;
+				}
+				data.insert(data.end(), ir.begin(), ir.end());
+			}
+		}
+	}
+	return new HRTFSet(directions, data);
+}
+
+} //(end anonymous namespace)
+
+//per-voice convolution state, allocated when the sample starts playing (never in the mixer):
+struct HRTFVoice {
+	HRTFVoice(uint32_t partitions_, uint32_t generation_) : partitions(partitions_), generation(generation_), history(partitions_ * HRTFBins) { }
+	uint32_t partitions;
+	uint32_t generation; //HRTFSet::generation of the set this voice was started with
+	std::vector< std::complex< float > > history; //input spectra, most recent at 'newest'
+	uint32_t newest = 0;
+	float frame[HRTFSize] = {}; //previous block of input followed by the block being filled
+	uint32_t fill = 0; //samples in the block being filled
+	float out_l[HRTFBlock] = {}; //output of the last transformed block, played while the next block fills
+	float out_r[HRTFBlock] = {};
+	uint32_t direction = -1U; //response used for the last block (changes are crossfaded)
+	uint32_t tail = 0; //samples of output still to play after the sample itself has finished
+};
+
+namespace {
+
+//can a voice keep using hrtf_set? (if the set was swapped out, 'direction' may not exist in the new one)
+// Voices that can't keep it drop their convolution state, and are panned instead.
+bool hrtf_current(HRTFVoice &voice) {
+	if (hrtf_set && voice.generation == hrtf_set->generation) return true;
+	voice.direction = -1U;
+	voice.tail = 0;
+	return false;
+}
+
+//transform the block of input that just filled, and compute the next block of output:
+void hrtf_block(HRTFVoice &voice, HRTFSet const &set, uint32_t direction) {
+	hrtf_fft.forward_real(voice.frame, voice.history.data() + voice.newest * HRTFBins);
+	std::copy(voice.frame + HRTFBlock, voice.frame + HRTFSize, voice.frame);
+
+	//filter with a direction's responses, writing HRTFBlock samples to l and r:
+	auto render = [&voice, &set](uint32_t d, float *l, float *r) {
+		float yl_re[HRTFBins] = {}, yl_im[HRTFBins] = {};
+		float yr_re[HRTFBins] = {}, yr_im[HRTFBins] = {};
+		for (uint32_t p = 0; p < voice.partitions; ++p) {
+			std::complex< float > const *x = voice.history.data() + ((voice.newest + voice.partitions - p) % voice.partitions) * HRTFBins;
+			std::complex< float > const *hl = set.response(d, 0, p);
+			std::complex< float > const *hr = set.response(d, 1, p);
+			for (uint32_t k = 0; k < HRTFBins; ++k) {
+				yl_re[k] += x[k].real() * hl[k].real() - x[k].imag() * hl[k].imag();
+				yl_im[k] += x[k].real() * hl[k].imag() + x[k].imag() * hl[k].real();
+				yr_re[k] += x[k].real() * hr[k].real() - x[k].imag() * hr[k].imag();
+				yr_im[k] += x[k].real() * hr[k].imag() + x[k].imag() * hr[k].real();
+			}
+		}
+		//both outputs are real, so they can share one inverse transform as z = l + i r:
+		std::complex< float > z[HRTFSize];
+		for (uint32_t k = 0; k < HRTFBins; ++k) {
+			z[k] = std::complex< float >(yl_re[k] - yr_im[k], yl_im[k] + yr_re[k]);
+		}
+		for (uint32_t k = 1; k < HRTFBlock; ++k) {
+			z[HRTFSize - k] = std::complex< float >(yl_re[k] + yr_im[k], yr_re[k] - yl_im[k]);
+		}
+		hrtf_fft.inverse(z);
+		//(overlap-save: only the second half is free of wrap-around)
+		for (uint32_t i = 0; i < HRTFBlock; ++i) {
+			l[i] = z[HRTFBlock + i].real() * (1.0f / HRTFSize);
+			r[i] = z[HRTFBlock + i].imag() * (1.0f / HRTFSize);
+		}
+	};
+
+	render(direction, voice.out_l, voice.out_r);
+	if (voice.direction != -1U && voice.direction != direction) {
+		//crossfade from the previous direction's responses over the block:
+		float old_l[HRTFBlock], old_r[HRTFBlock];
+		render(voice.direction, old_l, old_r);
+		for (uint32_t i = 0; i < HRTFBlock; ++i) {
+			float amt = (i + 0.5f) / HRTFBlock;
+			voice.out_l[i] = old_l[i] + amt * (voice.out_l[i] - old_l[i]);
+			voice.out_r[i] = old_r[i] + amt * (voice.out_r[i] - old_r[i]);
+		}
+	}
+	voice.direction = direction;
+	voice.newest = (voice.newest + 1) % voice.partitions;
+}
+
+//run input[begin,end) (mono, in .l) through a voice's convolution, adding output to out[begin,end):
+// (output lags input by one HRTFBlock; 'directions' gives the response to use for each sub-block)
+void run_hrtf(HRTFVoice &voice, HRTFSet const &set, LR const *input, uint32_t begin, uint32_t end, uint32_t const *directions, LR *out) {
+	for (uint32_t s = begin; s < end; /* later */) {
+		uint32_t count = std::min(end - s, HRTFBlock - voice.fill);
+		float *frame = voice.frame + HRTFBlock + voice.fill;
+		float const *l = voice.out_l + voice.fill;
+		float const *r = voice.out_r + voice.fill;
+		for (uint32_t i = 0; i < count; ++i) {
+			frame[i] = input[s + i].l;
+			out[s + i].l += l[i];
+			out[s + i].r += r[i];
+		}
+		s += count;
+		voice.fill += count;
+		if (voice.fill == HRTFBlock) {
+			hrtf_block(voice, set, directions[(s - 1) / RampSamples]);
+			voice.fill = 0;
+		}
+	}
+}
+
+//where voices are mixed to: the dry output plus a send buffer for each active reverb zone:
+struct MixTarget {
+	LR *dry;
+	float *send[MaxReverbZones];
+};
+float reverb_send[MaxReverbZones][ChunkSamples];
 
-		//Figure out sample panning/volume at start and end of the mix period:
-		LR start_pan;
-		compute_pan_from_listener_and_position(start_position, start_right, source.position.value, &start_pan.l, &start_pan.r);
-		start_pan.l *= start_volume * source.volume.value;
-		start_pan.r *= start_volume * source.volume.value;
+//quiet (usually distant) voices are mixed at half or quarter rate into sub-buses, which
+// are upsampled into the output once per chunk. Distance already dulls these voices (and
+// they are quiet), so averaging input samples is enough of an anti-aliasing filter and
+// linear interpolation is enough of a reconstruction filter:
+bool multirate = true;
+constexpr const float HalfRateGain = 0.1f; //(-20dB) voices quieter than this are mixed at half rate
+constexpr const float QuarterRateGain = 0.03f; //(-30dB) ...and quieter than this at quarter rate
+constexpr const float RateHysteresis = 1.25f; //voices return to a higher rate only once this much louder than its threshold
+struct SubBus {
+	SubBus(uint32_t rate_) : rate(rate_) { }
+	uint32_t rate; //mixes at AudioRate >> rate
+	LR dry[ChunkSamples / 2];
+	float send[MaxReverbZones][ChunkSamples / 2];
+	LR last_dry = LR{0.0f, 0.0f}; //last samples of the previous chunk (interpolated from)
+	float last_send[MaxReverbZones] = {};
+};
+SubBus sub_buses[2] = { SubBus(1), SubBus(2) };
 
-		step_position_ramp(source.position);
-		step_value_ramp(source.volume);
+//pick the rate for a voice of a given loudness (with hysteresis around the thresholds):
+uint32_t choose_rate(uint32_t rate, float loudness) {
+	if (rate >= 2 && loudness < QuarterRateGain * RateHysteresis) return 2;
+	if (loudness < QuarterRateGain) return 2;
+	if (rate >= 1 && loudness < HalfRateGain * RateHysteresis) return 1;
+	if (loudness < HalfRateGain) return 1;
+	return 0;
+}
 
-		LR end_pan;
-		compute_pan_from_listener_and_position(end_position, end_right, source.position.value, &end_pan.l, &end_pan.r);
-		end_pan.l *= end_volume * source.volume.value;
-		end_pan.r *= end_volume * source.volume.value;
+//mix 'count' (sub-bus) samples of data into dry (and wet, if not null), averaging each Factor samples of data:
+template< uint32_t Factor >
+void mix_run(float const *data, uint32_t count, LR *dry, float *wet, Gains &pan_, Gains const &step) {
+	Gains pan = pan_; //(local copy, so the compiler knows writing the output doesn't change it)
+	if (wet) {
+		for (uint32_t i = 0; i < count; ++i) {
+			float value = data[i * Factor];
+			for (uint32_t j = 1; j < Factor; ++j) value += data[i * Factor + j];
+			if (Factor > 1) value *= 1.0f / Factor;
 
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MixSamples;
-		pan_step.r = (end_pan.r - start_pan.r) / MixSamples;
+			//mix one sample based on current pan values:
+			dry[i].l += pan.l * value;
+			dry[i].r += pan.r * value;
+			wet[i] += pan.send * value;
 
-		assert(source.i < source.data.size());
+			//update pan values:
+			pan.l += step.l;
+			pan.r += step.r;
+			pan.send += step.send;
+		}
+	} else {
+		for (uint32_t i = 0; i < count; ++i) {
+			float value = data[i * Factor];
+			for (uint32_t j = 1; j < Factor; ++j) value += data[i * Factor + j];
+			if (Factor > 1) value *= 1.0f / Factor;
 
-		for (uint32_t i = 0; i < MixSamples; ++i) {
 			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * source.data[source.i];
-			buffer[i].r += pan.r * source.data[source.i];
+			dry[i].l += pan.l * value;
+			dry[i].r += pan.r * value;
+
+			//update pan values:
+			pan.l += step.l;
+			pan.r += step.r;
+		}
+	}
+	pan_ = pan;
+}
+
+//add 'count' samples of a sub-bus into full-rate output, interpolating linearly from 'last'
+// (the sub-bus's previous sample) so each sub-bus sample lands on the last of its 'factor' outputs:
+void upsample_add(LR const *bus, uint32_t count, uint32_t factor, LR &last, LR *out) {
+	float const inv = 1.0f / factor;
+	for (uint32_t i = 0; i < count; ++i) {
+		LR from = last, to = bus[i];
+		for (uint32_t j = 0; j < factor; ++j) {
+			float amt = (j + 1) * inv;
+			out[i * factor + j].l += from.l + amt * (to.l - from.l);
+			out[i * factor + j].r += from.r + amt * (to.r - from.r);
+		}
+		last = to;
+	}
+}
+void upsample_add(float const *bus, uint32_t count, uint32_t factor, float &last, float *out) {
+	float const inv = 1.0f / factor;
+	for (uint32_t i = 0; i < count; ++i) {
+		float from = last, to = bus[i];
+		for (uint32_t j = 0; j < factor; ++j) {
+			out[i * factor + j] += from + (j + 1) * inv * (to - from);
+		}
+		last = to;
+	}
+}
+
+//Voices are mixed by "lanes": the callback's lane mixes straight into the output, the
+// reverb sends, and the sub-buses; each mixing thread's lane mixes into buffers of its own,
+// which are added into the output once every voice has been mixed:
+struct MixLane {
+	MixTarget target; //full-rate voices mix here
+	MixTarget sub_targets[2]; //...and reduced-rate voices here
+	bool sub_used[2] = {false, false}; //did any voice mix into sub_targets[r] this chunk?
+	LR hrtf_input[ChunkSamples]; //binaural voices are mixed here before convolution
+	uint32_t hrtf_direction[ChunkSubBlocks]; //...with the response to use for each sub-block
+};
+MixLane output_lane;
+
+struct WorkerLane : MixLane {
+	uint32_t generation = 0; //chunk this lane's buffers were last cleared for
+	LR dry[ChunkSamples];
+	float send[MaxReverbZones][ChunkSamples];
+	LR sub_dry[2][ChunkSamples / 2];
+	float sub_send[2][MaxReverbZones][ChunkSamples / 2];
+};
+
+//what every lane needs to know about the chunk being mixed (set before any voice is mixed):
+struct {
+	uint32_t frames = 0;
+	uint32_t sub_blocks = 0;
+	uint64_t time = 0; //mixer time at the start of the chunk
+	bool multirate = false; //whether voices may use the sub-buses
+	bool send[MaxReverbZones]; //whether each zone is active
+	//listener state at each sub-block boundary:
+	ListenerState at[ChunkSubBlocks + 1];
+	//...and (by interpolation) at any sample in the chunk:
+	ListenerState listener_at(uint32_t s) const {
+		uint32_t b = s / RampSamples;
+		if (b >= sub_blocks) return at[sub_blocks];
+		if (s == b * RampSamples) return at[b]; //(segments usually start and end on sub-block boundaries)
+		float amt = (s - b * RampSamples) / float(std::min(RampSamples, frames - b * RampSamples));
+		ListenerState ret;
+		ret.position = glm::mix(at[b].position, at[b+1].position, amt);
+		ret.right = glm::mix(at[b].right, at[b+1].right, amt);
+		ret.up = glm::mix(at[b].up, at[b+1].up, amt);
+		ret.volume = glm::mix(at[b].volume, at[b+1].volume, amt);
+		return ret;
+	}
+} chunk;
+
+//mix one chunk of a sample into a lane; returns true if the sample is done playing:
+bool mix_voice(PlayingSample &source, MixLane &lane) {
+	uint32_t const frames = chunk.frames;
+	uint32_t const sub_blocks = chunk.sub_blocks;
+	uint64_t const chunk_time = chunk.time;
+	auto listener_at = [](uint32_t s) { return chunk.listener_at(s); };
+	MixTarget const &target = lane.target;
+	LR *hrtf_input = lane.hrtf_input;
+	uint32_t *hrtf_direction = lane.hrtf_direction;
+
+	//binaural samples that have finished still have the tails of their responses to play:
+	if (source.hrtf && source.hrtf->tail) {
+		uint32_t count = std::min(frames, source.hrtf->tail);
+		if (hrtf_current(*source.hrtf) && source.hrtf->direction != -1U) {
+			std::fill(hrtf_input, hrtf_input + count, LR{0.0f, 0.0f});
+			std::fill(hrtf_direction, hrtf_direction + ChunkSubBlocks, source.hrtf->direction);
+			run_hrtf(*source.hrtf, *hrtf_set, hrtf_input, 0, count, hrtf_direction, target.dry);
+			source.hrtf->tail -= count;
+		} else {
+			source.hrtf->tail = 0;
+		}
+		return source.hrtf->tail == 0;
+	}
+
+	assert(source.i < source.size);
+
+	//samples scheduled to start later don't play (or ramp) yet:
+	if (source.start_time >= chunk_time + frames) return false;
+	uint32_t first = (source.start_time > chunk_time ? uint32_t(source.start_time - chunk_time) : 0);
+
+	//binaural samples are mixed (unpanned) into hrtf_input, then convolved into the output:
+	bool binaural = (source.hrtf && hrtf_current(*source.hrtf));
+	if (binaural) {
+		std::fill(hrtf_input + first, hrtf_input + frames, LR{0.0f, 0.0f});
+	}
+	//...using the response nearest the sample's direction (in listener space):
+	auto compute_direction = [&source](ListenerState const &state) {
+		glm::vec3 to = source.position.value - state.position;
+		glm::vec3 forward = glm::cross(state.up, state.right);
+		glm::vec3 dir = glm::vec3(glm::dot(to, state.right), glm::dot(to, forward), glm::dot(to, state.up));
+		return hrtf_set->nearest(dir == glm::vec3(0.0f) ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::normalize(dir));
+	};
+
+	//sample panning/volume (and reverb send) given a listener state:
+	uint32_t zone = reverb_zone_at(source.position.value);
+	auto compute_pan = [&source, &zone, binaural](ListenerState const &state) {
+		Gains pan;
+		if (binaural) {
+			//the responses do the panning, so just attenuate (the same way as below):
+			float distance = glm::length(source.position.value - state.position);
+			pan.l = (distance > 1.0f ? 1.0f / distance : 1.0f);
+			pan.r = 0.0f;
+		} else {
+			compute_pan_from_listener_and_position(state.position, state.right, source.position.value, &pan.l, &pan.r);
+		}
+		pan.l *= state.volume * source.volume.value;
+		pan.r *= state.volume * source.volume.value;
+		//reverberant sound falls off more slowly than direct sound:
+		pan.send = 0.0f;
+		if (zone != -1U) {
+			float distance = glm::length(source.position.value - state.position);
+			pan.send = state.volume * source.volume.value * reverb_zones[zone].send / std::max(1.0f, std::sqrt(distance));
+		}
+		return pan;
+	};
+
+	//Figure out sample panning/volume at the first sample to mix:
+	Gains pan = compute_pan(listener_at(first));
+
+	//quiet samples are mixed at a reduced rate (if nothing needs sample-accurate timing this chunk):
+	source.rate = uint8_t(choose_rate(source.rate, std::max(pan.l, pan.r)));
+	uint32_t rate = 0;
+	if (chunk.multirate && !binaural && first == 0 && source.stop_time >= chunk_time + frames) {
+		rate = source.rate;
+	}
+	MixTarget const &voice_target = (rate == 0 ? target : lane.sub_targets[rate - 1]);
+	if (rate != 0) lane.sub_used[rate - 1] = true;
+	LR *out = (binaural ? hrtf_input : voice_target.dry);
+	if (binaural) {
+		std::fill(hrtf_direction, hrtf_direction + ChunkSubBlocks, compute_direction(listener_at(first)));
+	}
+
+	bool finished = false;
+
+	//mix samples [begin,end), stepping ramps and moving 'pan' to its value at 'end':
+	auto mix_segment = [&](uint32_t begin, uint32_t end) {
+		//the send follows the sample into whichever zone it is in at the start of the segment:
+		// (when it changes zones, the new zone's send starts from the old zone's level)
+		zone = reverb_zone_at(source.position.value);
+		float *send = (zone != -1U ? voice_target.send[zone] : nullptr);
+
+		step_position_ramp(source.position, (end - begin) / float(AudioRate));
+		step_value_ramp(source.volume, (end - begin) / float(AudioRate));
+
+		Gains end_pan = compute_pan(listener_at(end));
+		if (binaural) hrtf_direction[(end - 1) / RampSamples] = compute_direction(listener_at(end));
+
+		//(steps are per output sample, which is per sub-bus sample at reduced rates)
+		uint32_t outputs = (end - begin) >> rate;
+		Gains pan_step;
+		pan_step.l = (end_pan.l - pan.l) / outputs;
+		pan_step.r = (end_pan.r - pan.r) / outputs;
+		pan_step.send = (end_pan.send - pan.send) / outputs;
+
+		for (uint32_t s = begin; s < end; /* later */) {
+			//mix as many samples as possible before the sample data runs out:
+			uint32_t count = std::min(end - s, source.size - source.i) >> rate;
+			float const *data = source.data + source.i;
+			LR *dry = out + (s >> rate);
+			float *wet = (send ? send + (s >> rate) : nullptr);
+			if (rate == 0) mix_run< 1 >(data, count, dry, wet, pan, pan_step);
+			else if (rate == 1) mix_run< 2 >(data, count, dry, wet, pan, pan_step);
+			else mix_run< 4 >(data, count, dry, wet, pan, pan_step);
+			s += count << rate;
 
 			//update position in sample:
-			source.i += 1;
-			if (source.i == source.data.size()) {
-				if (source.loop) source.i = 0;
-				else break;
+			source.i += count << rate;
+			if (rate != 0 && s < end && source.i < source.size) {
+				//data ran out partway through a group of samples; average what is left:
+				float value = 0.0f;
+				for (uint32_t i = source.i; i < source.size; ++i) value += source.data[i];
+				value *= 1.0f / (1 << rate);
+				dry[count].l += pan.l * value;
+				dry[count].r += pan.r * value;
+				if (wet) wet[count] += pan.send * value;
+				pan.l += pan_step.l;
+				pan.r += pan_step.r;
+				pan.send += pan_step.send;
+				s += 1 << rate;
+				source.i = source.size;
 			}
+			if (source.i == source.size) {
+				if (source.loop) {
+					source.i = 0;
+				} else {
+					finished = true;
+					break;
+				}
+			}
+		}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+		pan = end_pan;
+	};
+
+	for (uint32_t b = first / RampSamples; b < sub_blocks && !finished; ++b) {
+		uint32_t begin = std::max(b * RampSamples, first);
+		uint32_t end = std::min((b + 1) * RampSamples, frames);
+		while (begin < end && !finished) {
+			//scheduled stop has arrived, start stopping exactly here:
+			if (source.stop_time <= chunk_time + begin) {
+				source.stop_time = NoTime;
+				if (source.stop_ramp <= 0.0f) {
+					finished = true;
+					break;
+				}
+				source.stopped = true;
+				source.volume.target = 0.0f;
+				source.volume.ramp = source.stop_ramp;
+			}
+			//...otherwise mix up to the next scheduled stop or the end of the sub-block:
+			uint32_t split = end;
+			if (source.stop_time < chunk_time + end) split = uint32_t(source.stop_time - chunk_time);
+			mix_segment(begin, split);
+			begin = split;
+		}
+	}
+
+	if (binaural) {
+		run_hrtf(*source.hrtf, *hrtf_set, hrtf_input, first, frames, hrtf_direction, target.dry);
+	}
+
+	if (finished //non-looping sample has finished (or was stopped without a ramp)
+	 || (source.stopped && source.volume.ramp == 0.0f) //sample has finished stopping
+	 ) {
+		if (binaural) {
+			//keep the sample around to play out its responses' tails:
+			source.hrtf->tail = (source.hrtf->partitions + 1) * HRTFBlock;
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+//With many voices, the callback shares the mixing with worker threads: voices are split into
+// groups of VoiceGroupSize, and the callback and the workers each claim groups (by bumping
+// an atomic counter) until none are left. Workers mix into their own lanes, so the only
+// synchronization is that counter and a count of finished groups:
+constexpr const uint32_t VoiceGroupSize = 32;
+struct {
+	std::vector< std::unique_ptr< WorkerLane > > lanes; //one per worker
+	std::vector< std::thread > threads;
+	std::atomic< bool > running{false};
+	//(generation << 32) | next group to claim; the generation counts parallel chunks:
+	std::atomic< uint64_t > work{0};
+	std::atomic< uint32_t > groups{0}; //number of groups in the current generation
+	std::atomic< uint32_t > groups_done{0}; //groups of the current generation mixed so far
+} mix_workers;
+
+//the chunk's voices (pointers into playing_samples) and whether each is done playing:
+// (capacity is reserved when samples are played, so these don't allocate in the mixer)
+std::vector< PlayingSample * > chunk_voices;
+std::vector< uint8_t > chunk_voices_done;
+
+//claim the next group of a generation's voices, or return -1U if all have been claimed:
+uint32_t claim_group(uint32_t generation) {
+	uint64_t work = mix_workers.work.load(std::memory_order_acquire);
+	while (uint32_t(work >> 32) == generation && uint32_t(work) < mix_workers.groups.load(std::memory_order_relaxed)) {
+		if (mix_workers.work.compare_exchange_weak(work, work + 1, std::memory_order_acq_rel)) return uint32_t(work);
+	}
+	return -1U;
+}
+
+void mix_group(uint32_t group, MixLane &lane) {
+	uint32_t begin = group * VoiceGroupSize;
+	uint32_t end = std::min(begin + VoiceGroupSize, uint32_t(chunk_voices.size()));
+	for (uint32_t v = begin; v < end; ++v) {
+		chunk_voices_done[v] = mix_voice(*chunk_voices[v], lane);
+	}
+}
+
+//point a worker's lane at its own buffers, cleared for the current chunk:
+void clear_lane(WorkerLane &lane) {
+	lane.target.dry = lane.dry;
+	std::fill(lane.dry, lane.dry + chunk.frames, LR{0.0f, 0.0f});
+	for (uint32_t r = 0; r < 2; ++r) {
+		lane.sub_used[r] = false;
+		lane.sub_targets[r].dry = lane.sub_dry[r];
+		std::fill(lane.sub_dry[r], lane.sub_dry[r] + (chunk.frames >> (r + 1)), LR{0.0f, 0.0f});
+	}
+	for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+		if (chunk.send[z]) {
+			lane.target.send[z] = lane.send[z];
+			std::fill(lane.send[z], lane.send[z] + chunk.frames, 0.0f);
+			for (uint32_t r = 0; r < 2; ++r) {
+				lane.sub_targets[r].send[z] = lane.sub_send[r][z];
+				std::fill(lane.sub_send[r][z], lane.sub_send[r][z] + (chunk.frames >> (r + 1)), 0.0f);
+			}
+		} else {
+			lane.target.send[z] = nullptr;
+			for (uint32_t r = 0; r < 2; ++r) lane.sub_targets[r].send[z] = nullptr;
+		}
+	}
+}
+
+void mix_worker(uint32_t index) {
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL); //(may fail without permission; workers still help)
+	WorkerLane &lane = *mix_workers.lanes[index];
+	uint32_t seen = uint32_t(mix_workers.work.load() >> 32);
+	uint32_t idle = 0;
+	while (mix_workers.running.load(std::memory_order_relaxed)) {
+		uint32_t generation = uint32_t(mix_workers.work.load(std::memory_order_acquire) >> 32);
+		if (generation == seen) {
+			//wait for the next parallel chunk: spin briefly, then back off to sleeping
+			// (a worker that wakes up late just claims fewer groups):
+			idle += 1;
+			if (idle < 256) continue;
+			else if (idle < 512) std::this_thread::yield();
+			else std::this_thread::sleep_for(std::chrono::microseconds(250));
+			continue;
+		}
+		seen = generation;
+		idle = 0;
+
+		RealtimeCheck::Scope realtime;
+		for (uint32_t group = claim_group(generation); group != -1U; group = claim_group(generation)) {
+			if (lane.generation != generation) {
+				clear_lane(lane);
+				lane.generation = generation;
+			}
+			mix_group(group, lane);
+			mix_workers.groups_done.fetch_add(1, std::memory_order_release);
+		}
+	}
+}
+
+//add 'count' floats from 'in' to 'out': (a plain loop, which the compiler vectorizes)
+void add_floats(float const *in, uint32_t count, float *out) {
+	for (uint32_t i = 0; i < count; ++i) {
+		out[i] += in[i];
+	}
+}
+
+void mix_chunk(LR *buffer, uint32_t frames) {
+	assert(frames <= ChunkSamples);
+	chunk.frames = frames;
+	chunk.sub_blocks = (frames + RampSamples - 1) / RampSamples;
+	chunk.time = mixer_time;
+	mixer_time += frames;
+
+	//Figure out global info (listener position, volume) at each sub-block boundary:
+	for (uint32_t b = 0; b <= chunk.sub_blocks; ++b) {
+		chunk.at[b].position = listener.position.value;
+		chunk.at[b].right = listener.right.value;
+		chunk.at[b].up = listener.up.value;
+		chunk.at[b].volume = volume.value;
+		if (b < chunk.sub_blocks) {
+			float step = std::min(RampSamples, frames - b * RampSamples) / float(AudioRate);
+			step_position_ramp(listener.position, step);
+			step_direction_ramp(listener.right, step);
+			step_direction_ramp(listener.up, step);
+			step_value_ramp(volume, step);
 		}
+	}
 
-		if (source.i >= source.data.size() //non-looping sample has finished
-		 || (source.stopped && source.volume.ramp == 0.0f) //sample has finished stopping
-		 ) {
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+	//voices mix into the output and the active zones' sends:
+	MixTarget &target = output_lane.target;
+	target.dry = buffer;
+	for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+		chunk.send[z] = reverb_zones[z].active;
+		if (reverb_zones[z].active) {
+			target.send[z] = reverb_send[z];
+			std::fill(reverb_send[z], reverb_send[z] + frames, 0.0f);
 		} else {
-			++si;
+			target.send[z] = nullptr;
+		}
+	}
+	//...or into the sub-buses (only used when the chunk divides evenly into sub-bus samples):
+	chunk.multirate = multirate && (frames % 4 == 0);
+	for (uint32_t r = 0; r < 2; ++r) {
+		SubBus &bus = sub_buses[r];
+		output_lane.sub_used[r] = false;
+		output_lane.sub_targets[r].dry = bus.dry;
+		std::fill(bus.dry, bus.dry + (frames >> bus.rate), LR{0.0f, 0.0f});
+		for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+			if (target.send[z]) {
+				output_lane.sub_targets[r].send[z] = bus.send[z];
+				std::fill(bus.send[z], bus.send[z] + (frames >> bus.rate), 0.0f);
+			} else {
+				output_lane.sub_targets[r].send[z] = nullptr;
+				bus.last_send[z] = 0.0f;
+			}
+		}
+	}
+
+	//now add audio for each playing sample:
+	chunk_voices.clear();
+	for (auto const &playing : playing_samples) {
+		chunk_voices.emplace_back(playing.get());
+	}
+	chunk_voices_done.resize(chunk_voices.size());
+	uint32_t groups = uint32_t((chunk_voices.size() + VoiceGroupSize - 1) / VoiceGroupSize);
+	if (mix_workers.lanes.empty() || groups < 2) {
+		//(not worth waking anyone for)
+		for (uint32_t g = 0; g < groups; ++g) {
+			mix_group(g, output_lane);
+		}
+	} else {
+		//start a new generation of work, and claim groups along with the workers:
+		uint32_t generation = uint32_t(mix_workers.work.load(std::memory_order_relaxed) >> 32) + 1;
+		mix_workers.groups_done.store(0, std::memory_order_relaxed);
+		mix_workers.groups.store(groups, std::memory_order_relaxed);
+		mix_workers.work.store(uint64_t(generation) << 32, std::memory_order_release);
+		uint32_t mixed = 0;
+		for (uint32_t group = claim_group(generation); group != -1U; group = claim_group(generation)) {
+			mix_group(group, output_lane);
+			mixed += 1;
+		}
+		//wait for the groups the workers claimed:
+		while (mix_workers.groups_done.load(std::memory_order_acquire) + mixed < groups) {
+			//(spin; the wait is at most one group)
+		}
+
+		//add the workers' lanes into the output:
+		for (auto const &lane_ptr : mix_workers.lanes) {
+			WorkerLane const &lane = *lane_ptr;
+			if (lane.generation != generation) continue; //(didn't mix anything)
+			add_floats(reinterpret_cast< float const * >(lane.dry), 2 * frames, reinterpret_cast< float * >(buffer));
+			for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+				if (target.send[z]) add_floats(lane.send[z], frames, target.send[z]);
+			}
+			for (uint32_t r = 0; r < 2; ++r) {
+				if (!lane.sub_used[r]) continue;
+				output_lane.sub_used[r] = true;
+				add_floats(reinterpret_cast< float const * >(lane.sub_dry[r]), 2 * (frames >> (r + 1)), reinterpret_cast< float * >(sub_buses[r].dry));
+				for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+					if (target.send[z]) add_floats(lane.sub_send[r][z], frames >> (r + 1), sub_buses[r].send[z]);
+				}
+			}
 		}
 	}
 
-	//DEBUG: report output power:
+	//samples that are done playing are handed to unlock() to free:
+	uint32_t index = 0;
+	for (auto si = playing_samples.begin(); si != playing_samples.end(); ++index) {
+		auto old = si;
+		++si;
+		if (chunk_voices_done[index]) finished_samples.splice(finished_samples.end(), playing_samples, old);
+	}
+
+	//bring the sub-buses up to full rate (including one chunk after they were last used, to finish interpolating):
+	for (uint32_t r = 0; r < 2; ++r) {
+		SubBus &bus = sub_buses[r];
+		if (!output_lane.sub_used[r] && bus.last_dry.l == 0.0f && bus.last_dry.r == 0.0f) continue;
+		if (!chunk.multirate) {
+			//(chunk wasn't mixed in sub-buses at all, so just let the interpolation state go)
+			bus.last_dry = LR{0.0f, 0.0f};
+			std::fill(bus.last_send, bus.last_send + MaxReverbZones, 0.0f);
+			continue;
+		}
+		uint32_t factor = 1 << bus.rate;
+		upsample_add(bus.dry, frames >> bus.rate, factor, bus.last_dry, buffer);
+		for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+			if (target.send[z]) upsample_add(bus.send[z], frames >> bus.rate, factor, bus.last_send[z], target.send[z]);
+		}
+	}
+
+	//finally, run each zone's reverb once over everything sent to it:
+	for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+		if (!target.send[z]) continue;
+		for (uint32_t begin = 0; begin < frames; begin += RampSamples) {
+			uint32_t count = std::min(RampSamples, frames - begin);
+			run_reverb(reverb_zones[z], target.send[z] + begin, buffer + begin, count);
+		}
+	}
+}
+
+//mixes into a block of stereo output:
+void mix_block(float *stream, uint32_t frames) {
+	assert(stream); //should always have some audio buffer
+
+	RealtimeCheck::Scope realtime; //(nothing in here should allocate, free, or block)
+
+	auto block_start = std::chrono::steady_clock::now();
+	uint32_t block_voices = uint32_t(playing_samples.size());
+
+	LR *buffer = reinterpret_cast< LR * >(stream);
+
+	//zero the output buffer:
+	for (uint32_t s = 0; s < frames; ++s) {
+		buffer[s].l = 0.0f;
+		buffer[s].r = 0.0f;
+	}
+
+	for (uint32_t begin = 0; begin < frames; begin += ChunkSamples) {
+		mix_chunk(buffer + begin, std::min(ChunkSamples, frames - begin));
+	}
+
+	//record output level:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MixSamples; ++s) {
+	for (uint32_t s = 0; s < frames; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	//std::cout << "Max Power: " << std::sqrt(max_power) << std::endl; //DEBUG
 
+	{ //record timing statistics:
+		auto block_end = std::chrono::steady_clock::now();
+		uint32_t slot = uint32_t(mixer_stats.blocks % StatsWindow);
+		float budget = 1000.0f * frames / float(AudioRate);
+		mixer_stats.mix_ms[slot] = std::chrono::duration< float, std::milli >(block_end - block_start).count();
+		mixer_stats.budget_ms[slot] = budget;
+		mixer_stats.voices[slot] = block_voices;
+		mixer_stats.peak = std::sqrt(max_power);
+		if (mixer_stats.blocks == 0) {
+			mixer_stats.gap_ms[slot] = budget;
+			mixer_stats.xrun[slot] = false;
+		} else {
+			mixer_stats.gap_ms[slot] = std::chrono::duration< float, std::milli >(block_start - mixer_stats.last_start).count();
+			//if the previous block was requested this late, the device probably ran dry while waiting:
+			mixer_stats.xrun[slot] = (mixer_stats.gap_ms[slot] > 1.5f * budget);
+			if (mixer_stats.xrun[slot]) mixer_stats.xruns += 1;
+		}
+		mixer_stats.last_start = block_start;
+		mixer_stats.blocks += 1;
+	}
 };
 
+//SDL audio device callback:
+void mix_audio(void *, Uint8 *stream, int len) {
+	assert(len % (2 * sizeof(float)) == 0); //should be a whole number of stereo frames
+	mix_block(reinterpret_cast< float * >(stream), uint32_t(len / (2 * sizeof(float))));
+}
+
 SDL_AudioDeviceID device = 0;
+uint32_t device_samples = MixSamples; //block size actually used by the device
+
+//headless output -- a thread that runs the mixer instead of an audio device:
+struct {
+	std::thread thread;
+	std::atomic< bool > running{false};
+	std::recursive_mutex mutex; //plays the part of the device lock (note: lock() is called recursively)
+} headless;
+
+//write a header for a 32-bit float stereo .wav file holding 'frames' frames:
+void write_wav_header(std::ostream &out, uint32_t frames) {
+	uint32_t data_bytes = frames * 2 * sizeof(float);
+	auto u32 = [&out](uint32_t v) { out.write(reinterpret_cast< char const * >(&v), 4); };
+	auto u16 = [&out](uint16_t v) { out.write(reinterpret_cast< char const * >(&v), 2); };
+	out.write("RIFF", 4); u32(4 + (8 + 16) + (8 + data_bytes));
+	out.write("WAVE", 4);
+	out.write("fmt ", 4); u32(16);
+	u16(3); //WAVE_FORMAT_IEEE_FLOAT
+	u16(2); //channels
+	u32(AudioRate); //sample rate
+	u32(AudioRate * 2 * sizeof(float)); //bytes per second
+	u16(2 * sizeof(float)); //bytes per frame
+	u16(32); //bits per sample
+	out.write("data", 4); u32(data_bytes);
+}
+
+void run_headless(std::string wav_filename, bool realtime) {
+	std::ofstream wav;
+	if (wav_filename != "") {
+		wav.open(wav_filename, std::ios::binary);
+		if (!wav) {
+			std::cerr << "WARNING: failed to open '" << wav_filename << "' for headless audio output; discarding output." << std::endl;
+		} else {
+			write_wav_header(wav, 0); //(sizes are filled in on shutdown)
+		}
+	}
+
+	std::vector< float > block(device_samples * 2);
+	uint32_t frames = 0;
+	auto next_block = std::chrono::steady_clock::now();
+	while (headless.running) {
+		headless.mutex.lock();
+		mix_block(block.data(), device_samples);
+		headless.mutex.unlock();
+
+		if (wav.is_open()) {
+			wav.write(reinterpret_cast< char const * >(block.data()), block.size() * sizeof(float));
+			frames += device_samples;
+		}
+
+		//when standing in for a real device, mix at the rate a device would ask for blocks:
+		if (realtime) {
+			next_block += std::chrono::microseconds(uint64_t(device_samples) * 1000000 / AudioRate);
+			std::this_thread::sleep_until(next_block);
+		}
+	}
+
+	if (wav.is_open()) {
+		wav.seekp(0);
+		write_wav_header(wav, frames);
+	}
+}
+
+//converted sample cache files are a header followed by 'count' float values:
+struct CacheHeader {
+	char magic[4] = {'p','c','m','0'};
+	uint32_t rate = AudioRate; //rate data was converted to
+	uint64_t source_hash = 0; //hash of the source file's contents
+	uint32_t count = 0; //number of values following the header
+	float min = 0.0f; //range of values (reported at load time)
+	float max = 0.0f;
+	uint32_t padding = 0;
+};
+static_assert(sizeof(CacheHeader) == 32, "CacheHeader is packed");
+
+//64-bit FNV-1a hash, used to notice when source files change:
+uint64_t hash_bytes(std::vector< char > const &bytes) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : bytes) {
+		hash ^= uint64_t(uint8_t(c));
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
 
 } //end anon namespace
 
 //------------------
 
 Sample::Sample(std::string const &filename) {
+	std::vector< char > source;
+	{ //read the whole source file (for hashing and decoding):
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to open WAV file '" + filename + "'");
+		}
+		source.assign(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+	}
+	uint64_t source_hash = hash_bytes(source);
+	std::string cache_filename = filename + ".pcm";
+
+	//warm start: map data from the cache, if it was made from this exact file at this rate:
+	try {
+		std::unique_ptr< MappedFile > mapped(new MappedFile(cache_filename));
+		CacheHeader const *header = reinterpret_cast< CacheHeader const * >(mapped->data);
+		if (mapped->size >= sizeof(CacheHeader)
+		 && std::string(header->magic, 4) == "pcm0"
+		 && header->rate == AudioRate
+		 && header->source_hash == source_hash
+		 && mapped->size == sizeof(CacheHeader) + header->count * sizeof(float)) {
+			data = reinterpret_cast< float const * >(mapped->data + sizeof(CacheHeader));
+			size = header->count;
+			std::cout << "Range: " << header->min << ", " << header->max << " (cached)" << std::endl;
+			cache = std::move(mapped);
+			return;
+		}
+	} catch (std::runtime_error &) {
+		//no usable cache file; fall through to converting.
+	}
+
 	SDL_AudioSpec want;
 	SDL_zero(want);
 	want.freq = AudioRate;
@@ -210,7 +1244,7 @@ Sample::Sample(std::string const &filename) {
 	Uint8 *audio_buf = nullptr;
 	Uint32 audio_len = 0;
 
-	SDL_AudioSpec *have = SDL_LoadWAV(filename.c_str(), &want, &audio_buf, &audio_len);
+	SDL_AudioSpec *have = SDL_LoadWAV_RW(SDL_RWFromConstMem(source.data(), int(source.size())), 1, &want, &audio_buf, &audio_len);
 	if (!have) {
 		throw std::runtime_error("Failed to load WAV file '" + filename + "'; SDL says \"" + std::string(SDL_GetError()) + "\"");
 	}
@@ -224,32 +1258,92 @@ Sample::Sample(std::string const &filename) {
 		cvt.buf = (Uint8 *)SDL_malloc(cvt.len * cvt.len_mult);
 		SDL_memcpy(cvt.buf, audio_buf, audio_len);
 		SDL_ConvertAudio(&cvt);
-		data.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + cvt.len_cvt));
+		converted.assign(reinterpret_cast< float * >(cvt.buf), reinterpret_cast< float * >(cvt.buf + cvt.len_cvt));
 		SDL_free(cvt.buf);
 	} else {
-		data.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
+		converted.assign(reinterpret_cast< float * >(audio_buf), reinterpret_cast< float * >(audio_buf + audio_len));
 	}
 	SDL_FreeWAV(audio_buf);
 
+	data = converted.data();
+	size = uint32_t(converted.size());
+
 	float min = 0.0f;
 	float max = 0.0f;
-	for (auto d : data) {
+	for (auto d : converted) {
 		min = std::min(min, d);
 		max = std::max(max, d);
 	}
 	std::cout << "Range: " << min << ", " << max << std::endl;
+
+	{ //write converted data to the cache for next time:
+		CacheHeader header;
+		header.source_hash = source_hash;
+		header.count = size;
+		header.min = min;
+		header.max = max;
+
+		//write to a temporary file first so a partially-written cache is never mapped:
+		std::string temp_filename = cache_filename + ".tmp";
+		std::ofstream out(temp_filename, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(converted.data()), converted.size() * sizeof(float));
+		out.close();
+		if (!out) {
+			std::cerr << "WARNING: failed to write sample cache '" << cache_filename << "'." << std::endl;
+			std::remove(temp_filename.c_str());
+		} else {
+			std::remove(cache_filename.c_str()); //(rename won't replace existing files on windows)
+			if (std::rename(temp_filename.c_str(), cache_filename.c_str()) != 0) {
+				std::cerr << "WARNING: failed to rename sample cache '" << temp_filename << "'." << std::endl;
+				std::remove(temp_filename.c_str());
+			}
+		}
+	}
+}
+
+Sample::Sample(std::vector< float > const &data_) : converted(data_) {
+	data = converted.data();
+	size = uint32_t(converted.size());
+}
+
+Sample::~Sample() {
 }
 
 std::shared_ptr< PlayingSample > Sample::play(glm::vec3 const &position, float volume, LoopOrOnce loop_or_once) const {
+	return play_at(0, position, volume, loop_or_once);
+}
+
+std::shared_ptr< PlayingSample > Sample::play_at(uint64_t time, glm::vec3 const &position, float volume, LoopOrOnce loop_or_once) const {
+	std::shared_ptr< PlayingSample > playing = std::make_shared< PlayingSample >(this, position, volume, loop_or_once == Loop);
+	playing->start_time = time;
+	if (hrtf_set) {
+		playing->hrtf.reset(new HRTFVoice(hrtf_set->partitions, hrtf_set->generation));
+	}
+	//(list node is allocated before locking, so the mixer isn't kept waiting for it)
+	std::list< std::shared_ptr< PlayingSample > > node;
+	node.emplace_back(playing);
 	lock();
-	playing_samples.emplace_back(std::make_shared< PlayingSample >(this, position, volume, loop_or_once == Loop));
+	playing_samples.splice(playing_samples.end(), node);
+	if (chunk_voices.capacity() < playing_samples.size()) {
+		//(so the mixer's per-chunk voice lists never need to grow)
+		chunk_voices.reserve(2 * playing_samples.size());
+		chunk_voices_done.reserve(2 * playing_samples.size());
+	}
 	unlock();
-	return playing_samples.back();
+	return playing;
 }
 
 
 //------------------
 
+PlayingSample::PlayingSample(Sample const *sample_, glm::vec3 const &position_, float volume_, bool loop_)
+	: data(sample_->data), size(sample_->size), loop(loop_), position(position_), volume(volume_) {
+}
+
+PlayingSample::~PlayingSample() {
+}
+
 void PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
 	lock();
 	position.set(new_position, ramp);
@@ -274,6 +1368,13 @@ void PlayingSample::stop(float ramp) {
 	unlock();
 }
 
+void PlayingSample::stop_at(uint64_t time, float ramp) {
+	lock();
+	stop_time = time;
+	stop_ramp = ramp;
+	unlock();
+}
+
 //------------------
 
 void Listener::set_position(glm::vec3 const &new_position, float ramp) {
@@ -293,11 +1394,24 @@ void Listener::set_right(glm::vec3 const &new_right, float ramp) {
 	unlock();
 }
 
+void Listener::set_up(glm::vec3 const &new_up, float ramp) {
+	lock();
+	if (new_up == glm::vec3(0.0f)) {
+		up.set(glm::vec3(0.0f, 0.0f, 1.0f), ramp);
+	} else {
+		up.set(glm::normalize(new_up), ramp);
+	}
+	unlock();
+}
+
 //------------------
 
-void init() {
+void init(uint32_t samples) {
+	device_samples = samples;
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
+		std::cerr << "Falling back to headless audio output." << std::endl;
+		init_headless("", true);
 		return;
 	}
 
@@ -307,25 +1421,220 @@ void init() {
 	want.freq = AudioRate;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MixSamples;
+	want.samples = Uint16(samples);
 	want.callback = mix_audio;
 
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//the mixer can handle any block size, so let the device pick whatever suits it best:
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
+		//keep mixing (and discarding) in real time so playing samples still advance and finish:
+		std::cerr << "Falling back to headless audio output." << std::endl;
+		init_headless("", true);
 	} else {
 		//start audio playback:
+		device_samples = have.samples;
 		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (" << have.samples << " sample blocks, "
+		          << (1000.0f * have.samples / float(AudioRate)) << " ms)." << std::endl;
+	}
+}
+
+void init_headless(std::string const &wav_filename, bool realtime) {
+	assert(!device && !headless.running);
+	headless.running = true;
+	headless.thread = std::thread(run_headless, wav_filename, realtime);
+	std::cout << "Headless audio output initialized";
+	if (wav_filename != "") std::cout << " (writing to '" << wav_filename << "')";
+	std::cout << "." << std::endl;
+}
+
+void shutdown() {
+	if (device) {
+		SDL_CloseAudioDevice(device);
+		device = 0;
+	}
+	if (headless.running) {
+		headless.running = false;
+		headless.thread.join();
+	}
+	set_mix_threads(0);
+}
+
+void set_mix_threads(uint32_t count) {
+	//(workers spin while mixing, as does the audio thread waiting for them, so there is no point in more than one per other core)
+	count = std::min(count, std::max(1U, std::thread::hardware_concurrency()) - 1);
+	lock();
+	//stop any current workers (between chunks, so they are all idle):
+	mix_workers.running = false;
+	for (auto &thread : mix_workers.threads) {
+		thread.join();
 	}
+	mix_workers.threads.clear();
+	mix_workers.lanes.clear();
+
+	mix_workers.running = true;
+	for (uint32_t i = 0; i < count; ++i) {
+		mix_workers.lanes.emplace_back(new WorkerLane);
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		mix_workers.threads.emplace_back(mix_worker, i);
+	}
+	unlock();
+}
+
+uint64_t now() {
+	lock();
+	uint64_t ret = mixer_time;
+	unlock();
+	return ret;
+}
+
+void mix(float *buffer, uint32_t frames) {
+	mix_block(buffer, frames);
 }
 
 void lock() {
+	RealtimeCheck::blocking("Sound::lock");
 	if (device) SDL_LockAudioDevice(device);
+	else if (headless.running) headless.mutex.lock();
 }
 
 void unlock() {
+	//take samples the mixer has finished with, to free once the mixer can run again:
+	std::list< std::shared_ptr< PlayingSample > > finished;
+	finished.swap(finished_samples);
 	if (device) SDL_UnlockAudioDevice(device);
+	else if (headless.running) headless.mutex.unlock();
+}
+
+Stats stats() {
+	Stats ret;
+	lock();
+	ret.blocks = mixer_stats.blocks;
+	ret.xruns = mixer_stats.xruns;
+	ret.peak = mixer_stats.peak;
+	if (mixer_stats.blocks > 0) {
+		uint32_t last = uint32_t((mixer_stats.blocks - 1) % StatsWindow);
+		ret.mix_ms = mixer_stats.mix_ms[last];
+		ret.gap_ms = mixer_stats.gap_ms[last];
+		ret.budget_ms = mixer_stats.budget_ms[last];
+		ret.voices = mixer_stats.voices[last];
+		ret.load = ret.mix_ms / ret.budget_ms;
+
+		uint32_t count = uint32_t(std::min< uint64_t >(mixer_stats.blocks, StatsWindow));
+		for (uint32_t i = 0; i < count; ++i) {
+			ret.worst_mix_ms = std::max(ret.worst_mix_ms, mixer_stats.mix_ms[i]);
+			ret.worst_gap_ms = std::max(ret.worst_gap_ms, mixer_stats.gap_ms[i]);
+			ret.worst_load = std::max(ret.worst_load, mixer_stats.mix_ms[i] / mixer_stats.budget_ms[i]);
+			ret.peak_voices = std::max(ret.peak_voices, mixer_stats.voices[i]);
+			if (mixer_stats.xrun[i]) ret.recent_xruns += 1;
+		}
+	}
+	unlock();
+	return ret;
+}
+
+void set_positions(std::vector< PositionUpdate > const &updates, float ramp) {
+	lock();
+	for (auto const &update : updates) {
+		update.sample->position.set(update.position, ramp);
+	}
+	unlock();
+}
+
+uint32_t add_reverb_zone(glm::vec3 const &min, glm::vec3 const &max, float absorption, float send) {
+	ReverbZone zone;
+	zone.min = glm::min(min, max);
+	zone.max = glm::max(min, max);
+	zone.send = send;
+
+	//Sabine's formula gives the decay time from the room's volume and surface area:
+	glm::vec3 size = glm::max(zone.max - zone.min, glm::vec3(0.1f));
+	float room_volume = size.x * size.y * size.z;
+	float surface = 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	absorption = glm::clamp(absorption, 0.01f, 1.0f);
+	float rt60 = glm::clamp(0.161f * room_volume / (surface * absorption), 0.05f, 8.0f);
+
+	//lines are spread around the time sound takes to cross the room between reflections:
+	float mean_free_path = 4.0f * room_volume / surface;
+	float base = mean_free_path / 343.0f * AudioRate;
+	static const float spread[ReverbLines] = { 1.0f, 1.17f, 1.31f, 1.47f, 1.63f, 1.79f, 1.97f, 2.17f };
+	for (uint32_t k = 0; k < ReverbLines; ++k) {
+		uint32_t length = uint32_t(base * spread[k]) | 1; //(odd lengths are less likely to share factors)
+		zone.length[k] = glm::clamp(length, RampSamples, ReverbLineSize - RampSamples);
+		//lose 60dB every rt60 seconds:
+		zone.gain[k] = std::pow(10.0f, -3.0f * zone.length[k] / (rt60 * AudioRate));
+		zone.damp_state[k] = 0.0f;
+	}
+	//absorbent rooms soak up high frequencies more:
+	zone.damping = 0.1f + 0.6f * absorption;
+	zone.wet = 1.0f / std::sqrt(float(ReverbLines / 2));
+	zone.lines.assign(ReverbLines * ReverbLineSize, 0.0f); //(allocated here, not in the audio callback)
+
+	uint32_t index = -1U;
+	lock();
+	for (uint32_t z = 0; z < MaxReverbZones; ++z) {
+		if (!reverb_zones[z].active) {
+			index = z;
+			zone.active = true;
+			std::swap(reverb_zones[z], zone);
+			break;
+		}
+	}
+	unlock();
+	if (index == -1U) {
+		std::cerr << "WARNING: all " << MaxReverbZones << " reverb zones are in use; not adding another." << std::endl;
+	}
+	return index;
+}
+
+void remove_reverb_zone(uint32_t index) {
+	if (index >= MaxReverbZones) return;
+	ReverbZone removed;
+	lock();
+	std::swap(reverb_zones[index], removed);
+	unlock();
+	//(removed's delay lines are freed here, outside the lock)
+}
+
+void enable_hrtf(std::string const &filename) {
+	std::unique_ptr< HRTFSet > set;
+	if (filename != "") {
+		try {
+			std::ifstream file(filename, std::ios::binary);
+			std::vector< glm::vec3 > directions;
+			std::vector< float > data;
+			read_chunk(file, "hrd0", &directions);
+			read_chunk(file, "hri0", &data);
+			set.reset(new HRTFSet(directions, data));
+		} catch (std::exception &e) {
+			std::cerr << "WARNING: failed to load HRTF from '" << filename << "' (" << e.what() << "); using a spherical head model instead." << std::endl;
+		}
+	}
+	if (!set) set.reset(make_spherical_head_hrtf());
+	std::cout << "HRTF rendering enabled (" << set->directions.size() << " directions, "
+	          << set->partitions * HRTFBlock << " taps)." << std::endl;
+
+	lock();
+	set->generation = ++hrtf_generation;
+	std::swap(hrtf_set, set);
+	unlock();
+	//(old set is freed here, outside the lock)
+}
+
+void disable_hrtf() {
+	std::unique_ptr< HRTFSet > set;
+	lock();
+	++hrtf_generation;
+	std::swap(hrtf_set, set);
+	unlock();
+}
+
+void set_multirate(bool enabled) {
+	lock();
+	multirate = enabled;
+	unlock();
 }
 
 void stop_all_samples() {
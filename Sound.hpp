@@ -2,14 +2,20 @@
 
 #include <memory>
 #include <vector>
+#include <string>
 
 #include <glm/glm.hpp>
 
 //A simple sound system for games.
 
+struct MappedFile;
+
 namespace Sound {
 
 struct PlayingSample;
+struct HRTFVoice;
+
+constexpr const uint64_t NoTime = -1ULL; //"never", on the mixer clock
 
 enum LoopOrOnce {
 	Once,
@@ -21,7 +27,12 @@ struct Sample {
 	//load from a ".wav" file:
 	// will warn and downmix to mono if file is stereo
 	// will warn and perform not-very-good interpolation if file is not Sound::AudioRate
+	//the converted data is cached next to the source file (as filename + ".pcm"),
+	// so later loads of an unchanged file just map the cache instead of converting:
 	Sample(std::string const &filename);
+	//use raw data (mono, Sound::AudioRate):
+	Sample(std::vector< float > const &data);
+	~Sample();
 
 	//start playing an instance of this sample at a given initial position and volume:
 	// the returned 'PlayingSample' handle can be used to change position, fade volume, or cancel playback.
@@ -31,7 +42,23 @@ struct Sample {
 		LoopOrOnce loop_or_once = Once
 	) const;
 
-	std::vector< float > data;
+	//start playing exactly at a given time on the mixer clock (see Sound::now()):
+	// (if that time has already been mixed, playback starts as soon as possible)
+	std::shared_ptr< PlayingSample > play_at(
+		uint64_t time,
+		glm::vec3 const &position,
+		float volume = 1.0f,
+		LoopOrOnce loop_or_once = Once
+	) const;
+
+	//mono, Sound::AudioRate sample data:
+	// (points into either 'converted' or 'cache')
+	float const *data = nullptr;
+	uint32_t size = 0;
+
+	//internals:
+	std::vector< float > converted; //holds data converted at load time
+	std::unique_ptr< MappedFile > cache; //holds data mapped from the cache file
 };
 
 //Ramp<> is a template to help with managing values that should be smoothly
@@ -60,36 +87,68 @@ struct PlayingSample {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	void stop(float ramp = 1.0f / 60.0f);
+	//start stopping exactly at a given time on the mixer clock:
+	// (a ramp of zero stops the sample right at 'time')
+	void stop_at(uint64_t time, float ramp = 1.0f / 60.0f);
 
 	//internals:
-	std::vector< float > const &data; //reference to sample data being played
+	float const *data; //sample data being played
+	uint32_t size; //number of values in data
 	uint32_t i = 0; //next data value to read
 	bool loop = false; //should playback loop after data runs out?
 	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
+	uint64_t start_time = 0; //mixer time at which playback starts
+	uint64_t stop_time = NoTime; //mixer time at which playback is scheduled to stop
+	float stop_ramp = 0.0f; //...and the ramp to use for stopping at that time
+	uint8_t rate = 0; //quiet samples are mixed at AudioRate >> rate (see set_multirate())
 
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f);
 	Ramp< float > volume = Ramp< float >(1.0f);
 
-	PlayingSample(Sample const *sample_, glm::vec3 const &position_, float volume_, bool loop_)
-		: data(sample_->data), loop(loop_), position(position_), volume(volume_) { }
+	std::unique_ptr< HRTFVoice > hrtf; //convolution state, for samples started while HRTF rendering is enabled
+
+	PlayingSample(Sample const *sample_, glm::vec3 const &position_, float volume_, bool loop_);
+	~PlayingSample();
 };
 
 struct Listener {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	void set_right(glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
+	void set_up(glm::vec3 const &new_up, float ramp = 1.0f / 60.0f); //(only matters for HRTF rendering)
 
 	//internals:
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f); //listener's location
 	Ramp< glm::vec3 > right = Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
+	Ramp< glm::vec3 > up = Ramp< glm::vec3 >(0.0f, 0.0f, 1.0f); //unit vector pointing up from the listener's head
 };
 extern struct Listener listener;
 
 
 
 constexpr const uint32_t AudioRate = 48000; //sample rate, in Hz, for audio output
-constexpr const uint32_t MixSamples = 1024; //samples to mix at once; SDL requires a power of two; smaller values mean more reactive sound, but require more frequent audio callback invocation
-
-void init(); //should call Sound::init() from main.cpp before using any member functions
+constexpr const uint32_t MixSamples = 1024; //default samples per device block; SDL requires a power of two; smaller values mean more reactive sound, but require more frequent audio callback invocation
+constexpr const uint32_t LowLatencyMixSamples = 256; //samples per device block in low-latency mode (about 5ms)
+constexpr const uint32_t RampSamples = 64; //the mixer advances ramps and panning every this many samples, whatever the device block size
+
+//should call Sound::init() from main.cpp before using any member functions:
+// 'samples' is the requested device block size; the device may pick a different one
+void init(uint32_t samples = MixSamples);
+
+//run without an audio device (e.g., on a machine with no sound card):
+// mixes blocks on a background thread and writes them to 'wav_filename' (float32 stereo),
+// or discards them if 'wav_filename' is empty.
+// blocks are mixed as fast as possible unless 'realtime' is set, in which case they are
+// mixed at the rate an audio device would consume them.
+// (init() falls back to realtime headless output if no audio device can be opened)
+void init_headless(std::string const &wav_filename = "", bool realtime = false);
+
+//stop the audio device or headless output thread (finishes writing any headless .wav file):
+void shutdown();
+
+//mix the next 'frames' stereo frames (interleaved left/right) into 'buffer':
+// this is what the audio device callback does; it is exposed for offline rendering and benchmarking.
+// (if output is running, call between lock() and unlock())
+void mix(float *buffer, uint32_t frames);
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
 // the set_*/stop/play/... functions already use these helpers, so you shouldn't need
@@ -99,7 +158,69 @@ void unlock();
 
 void stop_all_samples(); //sort of a 'panic button' to stop all playing samples
 
+//change the positions of many playing samples at once, locking only once:
+// (see Scene::update_sound_emitters)
+struct PositionUpdate {
+	PositionUpdate(PlayingSample *sample_, glm::vec3 const &position_) : sample(sample_), position(position_) { }
+	PlayingSample *sample;
+	glm::vec3 position;
+};
+void set_positions(std::vector< PositionUpdate > const &updates, float ramp = 1.0f / 60.0f);
+
+//reverb zones: samples playing inside a zone's box feed that zone's reverb.
+// Each zone has one shared reverb, so its cost doesn't depend on how many samples are playing.
+// Decay time and echo density come from the box's size and from how much sound its walls
+// absorb (0 = mirrors, 1 = open air):
+constexpr const uint32_t MaxReverbZones = 4;
+//returns the new zone's index, or -1U if all zones are in use:
+uint32_t add_reverb_zone(glm::vec3 const &min, glm::vec3 const &max, float absorption = 0.3f, float send = 0.5f);
+void remove_reverb_zone(uint32_t zone);
+
+//binaural (HRTF) rendering, for headphones: samples are filtered with head-related impulse
+// responses instead of being panned, so front/back and elevation can be heard.
+//Impulse responses are loaded from a file of chunks (see read_chunk.hpp):
+//  "hrd0": one glm::vec3 direction per response (listener space: x right, y forward, z up)
+//  "hri0": float taps at AudioRate; for each direction, the left ear's taps then the right ear's
+// (other formats, like SOFA, can be converted to this layout offline)
+//If filename is empty or fails to load, a simple spherical-head model is used instead.
+//Samples started while HRTF is enabled are rendered binaurally; others keep panning.
+void enable_hrtf(std::string const &filename = "");
+void disable_hrtf();
+
+//quiet (usually distant) samples are mixed at half or quarter rate, which makes them cheaper
+// without (much) audible difference; on by default:
+void set_multirate(bool enabled);
+
+//with many samples playing, mixing can be shared with 'count' worker threads: samples are
+// mixed in groups, each into a lane (buffer) of its own, and the lanes are added up at the end.
+//Workers are only woken when there are enough samples to split; off (0) by default, and at most one per core besides the audio thread's:
+void set_mix_threads(uint32_t count);
+
+//mixer performance statistics:
+// "worst"/"peak"/"recent" values are over the last 128 mixed blocks (a few seconds)
+struct Stats {
+	uint64_t blocks = 0; //blocks mixed so far
+	float budget_ms = 0.0f; //duration of the most recent block (mixing must take less than this)
+	float mix_ms = 0.0f; //time spent mixing the most recent block
+	float worst_mix_ms = 0.0f;
+	float load = 0.0f; //mix_ms / budget_ms -- at 1.0 the mixer can't keep up
+	float worst_load = 0.0f;
+	float gap_ms = 0.0f; //time between the starts of the two most recent blocks
+	float worst_gap_ms = 0.0f;
+	uint32_t voices = 0; //samples playing in the most recent block
+	uint32_t peak_voices = 0;
+	uint32_t xruns = 0; //blocks requested late enough that output probably underran
+	uint32_t recent_xruns = 0;
+	float peak = 0.0f; //peak output amplitude in the most recent block
+};
+Stats stats();
+
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
+//the mixer clock counts samples (at AudioRate) mixed since output started;
+// now() is the time of the next sample that will be mixed.
+// (output is mixed a block ahead, so this is slightly ahead of what is audible)
+uint64_t now();
+
 }; //namespace Sound
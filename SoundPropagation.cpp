@@ -0,0 +1,317 @@
+#include "SoundPropagation.hpp"
+#include "read_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+#include <limits>
+#include <cmath>
+
+//routes are cheap to recompute, so rather than tracking which are stale just start over past this many:
+static constexpr const size_t MaxRoutes = 1 << 16;
+
+SoundPropagation::SoundPropagation(std::vector< glm::vec3 > const &triangles, float cell_size_) : cell_size(cell_size_) {
+	build(triangles);
+}
+
+SoundPropagation::SoundPropagation(std::string const &filename, std::string const &mesh_name, glm::mat4x3 const &to_world, float cell_size_) : cell_size(cell_size_) {
+	std::ifstream file(filename, std::ios::binary);
+
+	//same layout as MeshBuffer's ".pnc" files:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1, "Vertex is packed.");
+	std::vector< Vertex > vertices;
+	read_chunk(file, "pnc.", &vertices);
+
+	std::vector< char > strings;
+	read_chunk(file, "str0", &strings);
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	std::vector< IndexEntry > index;
+	read_chunk(file, "idx0", &index);
+
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		if (std::string(&strings[0] + entry.name_begin, &strings[0] + entry.name_end) != mesh_name) continue;
+
+		std::vector< glm::vec3 > triangles;
+		triangles.reserve(entry.vertex_end - entry.vertex_begin);
+		for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+			triangles.emplace_back(to_world * glm::vec4(vertices[v].Position, 1.0f));
+		}
+		build(triangles);
+		return;
+	}
+	throw std::runtime_error("Mesh '" + mesh_name + "' not found in '" + filename + "'.");
+}
+
+void SoundPropagation::build(std::vector< glm::vec3 > const &triangles) {
+	if (triangles.size() % 3 != 0) {
+		throw std::runtime_error("SoundPropagation expects three vertices per triangle.");
+	}
+	if (!(cell_size > 0.0f)) {
+		throw std::runtime_error("SoundPropagation cell size must be positive.");
+	}
+
+	geometry_min = glm::vec3( std::numeric_limits< float >::infinity());
+	geometry_max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (auto const &v : triangles) {
+		geometry_min = glm::min(geometry_min, v);
+		geometry_max = glm::max(geometry_max, v);
+	}
+	if (triangles.empty()) {
+		geometry_min = geometry_max = glm::vec3(0.0f);
+	}
+
+	//grid covers the geometry's footprint, with a border of closed cells:
+	glm::vec2 min = glm::vec2(geometry_min);
+	glm::vec2 max = glm::vec2(geometry_max);
+	grid_min = min - glm::vec2(cell_size);
+	grid_size = glm::uvec2(glm::ceil((max - min) / cell_size)) + glm::uvec2(2);
+	open.assign(grid_size.x * grid_size.y, 0);
+
+	auto cell_coord = [this](glm::vec2 const &p) {
+		glm::ivec2 c = glm::ivec2(glm::floor((p - grid_min) / cell_size));
+		return glm::clamp(c, glm::ivec2(0), glm::ivec2(grid_size) - glm::ivec2(1));
+	};
+
+	//floors: open every cell whose center is covered (plus the cells holding the corners, so small triangles still count):
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+		glm::vec3 const &a = triangles[t], &b = triangles[t+1], &c = triangles[t+2];
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		if (len == 0.0f || n.z / len < 0.7f) continue;
+
+		glm::vec2 a2 = glm::vec2(a), b2 = glm::vec2(b), c2 = glm::vec2(c);
+		auto edge = [](glm::vec2 const &p0, glm::vec2 const &p1, glm::vec2 const &p) {
+			return (p1.x - p0.x) * (p.y - p0.y) - (p1.y - p0.y) * (p.x - p0.x);
+		};
+		glm::ivec2 lo = cell_coord(glm::min(a2, glm::min(b2, c2)));
+		glm::ivec2 hi = cell_coord(glm::max(a2, glm::max(b2, c2)));
+		for (int32_t y = lo.y; y <= hi.y; ++y) {
+			for (int32_t x = lo.x; x <= hi.x; ++x) {
+				glm::vec2 p = grid_min + (glm::vec2(x, y) + glm::vec2(0.5f)) * cell_size;
+				//(triangle is upward-facing, so its xy projection is counter-clockwise)
+				if (edge(a2, b2, p) >= 0.0f && edge(b2, c2, p) >= 0.0f && edge(c2, a2, p) >= 0.0f) {
+					open[y * grid_size.x + x] = 1;
+				}
+			}
+		}
+		for (auto const &p : {a2, b2, c2}) {
+			glm::ivec2 cc = cell_coord(p);
+			open[cc.y * grid_size.x + cc.x] = 1;
+		}
+	}
+
+	//walls: close every cell the triangle's footprint passes through:
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+		glm::vec3 const &a = triangles[t], &b = triangles[t+1], &c = triangles[t+2];
+		glm::vec3 n = glm::cross(b - a, c - a);
+		float len = glm::length(n);
+		if (len == 0.0f || std::abs(n.z / len) > 0.3f) continue;
+
+		//steep triangles are (nearly) flat in xy, so closing cells along the edges covers them:
+		glm::vec2 corners[3] = { glm::vec2(a), glm::vec2(b), glm::vec2(c) };
+		for (uint32_t e = 0; e < 3; ++e) {
+			glm::vec2 p0 = corners[e], p1 = corners[(e+1)%3];
+			uint32_t steps = uint32_t(std::ceil(glm::length(p1 - p0) / (0.25f * cell_size))) + 1;
+			for (uint32_t s = 0; s <= steps; ++s) {
+				glm::ivec2 cc = cell_coord(glm::mix(p0, p1, float(s) / float(steps)));
+				open[cc.y * grid_size.x + cc.x] = 0;
+			}
+		}
+	}
+
+	search_cost.assign(open.size(), 0.0f);
+	search_parent.assign(open.size(), -1U);
+	search_stamp.assign(open.size(), 0);
+	search_count = 0;
+	routes.clear();
+	listener_cell = cell_at(listener);
+}
+
+glm::vec2 SoundPropagation::cell_center(uint32_t cell) const {
+	return grid_min + (glm::vec2(cell % grid_size.x, cell / grid_size.x) + glm::vec2(0.5f)) * cell_size;
+}
+
+uint32_t SoundPropagation::cell_at(glm::vec3 const &position) const {
+	glm::vec2 p = (glm::vec2(position) - grid_min) / cell_size;
+	if (!(p.x >= 0.0f && p.y >= 0.0f && p.x < float(grid_size.x) && p.y < float(grid_size.y))) return -1U;
+	glm::ivec2 c = glm::ivec2(p);
+	if (open[c.y * grid_size.x + c.x]) return c.y * grid_size.x + c.x;
+
+	//sources are often right up against walls, which can close their cell; look for the closest open neighbor:
+	uint32_t best = -1U;
+	float best_dis2 = std::numeric_limits< float >::infinity();
+	for (int32_t y = std::max(0, c.y - 1); y <= std::min(int32_t(grid_size.y) - 1, c.y + 1); ++y) {
+		for (int32_t x = std::max(0, c.x - 1); x <= std::min(int32_t(grid_size.x) - 1, c.x + 1); ++x) {
+			uint32_t cell = y * grid_size.x + x;
+			if (!open[cell]) continue;
+			glm::vec2 to = cell_center(cell) - glm::vec2(position);
+			float dis2 = glm::dot(to, to);
+			if (dis2 < best_dis2) {
+				best_dis2 = dis2;
+				best = cell;
+			}
+		}
+	}
+	return best;
+}
+
+bool SoundPropagation::visible(uint32_t from, uint32_t to) const {
+	//walk every cell the segment between the centers touches:
+	int32_t x = from % grid_size.x, y = from / grid_size.x;
+	int32_t tx = to % grid_size.x, ty = to / grid_size.x;
+	int32_t dx = std::abs(tx - x), dy = std::abs(ty - y);
+	int32_t sx = (tx > x ? 1 : -1), sy = (ty > y ? 1 : -1);
+	int32_t error = dx - dy;
+	for (int32_t n = 1 + dx + dy; n > 0; --n) {
+		if (!open[y * grid_size.x + x]) return false;
+		if (error > 0) {
+			x += sx;
+			error -= 2 * dy;
+		} else {
+			y += sy;
+			error += 2 * dx;
+		}
+	}
+	return true;
+}
+
+SoundPropagation::Route const &SoundPropagation::route(uint32_t from, uint32_t to) {
+	uint64_t key = (uint64_t(from) << 32) | uint64_t(to);
+	auto f = routes.find(key);
+	if (f != routes.end()) return f->second;
+
+	if (routes.size() >= MaxRoutes) routes.clear();
+	Route &route = routes[key];
+
+	if (visible(from, to)) {
+		route.distance = glm::length(cell_center(to) - cell_center(from));
+		route.via = to;
+		route.visible = true;
+		return route;
+	}
+
+	//A* over the 8-connected grid (costs in cells, no cutting past closed corners):
+	++search_count;
+	if (search_count == 0) {
+		std::fill(search_stamp.begin(), search_stamp.end(), 0);
+		search_count = 1;
+	}
+	int32_t tx = to % grid_size.x, ty = to / grid_size.x;
+	auto heuristic = [&](uint32_t cell) {
+		float dx = float(std::abs(int32_t(cell % grid_size.x) - tx));
+		float dy = float(std::abs(int32_t(cell / grid_size.x) - ty));
+		return std::max(dx, dy) + (std::sqrt(2.0f) - 1.0f) * std::min(dx, dy);
+	};
+	auto heap_order = std::greater< std::pair< float, uint32_t > >();
+
+	search_heap.clear();
+	search_stamp[from] = search_count;
+	search_cost[from] = 0.0f;
+	search_parent[from] = -1U;
+	search_heap.emplace_back(heuristic(from), from);
+
+	bool found = false;
+	while (!search_heap.empty()) {
+		std::pop_heap(search_heap.begin(), search_heap.end(), heap_order);
+		float priority = search_heap.back().first;
+		uint32_t cell = search_heap.back().second;
+		search_heap.pop_back();
+		if (cell == to) {
+			found = true;
+			break;
+		}
+		//skip stale heap entries:
+		if (priority > search_cost[cell] + heuristic(cell) + 1e-4f) continue;
+
+		int32_t x = cell % grid_size.x, y = cell / grid_size.x;
+		for (int32_t oy = -1; oy <= 1; ++oy) {
+			for (int32_t ox = -1; ox <= 1; ++ox) {
+				if (ox == 0 && oy == 0) continue;
+				int32_t nx = x + ox, ny = y + oy;
+				if (nx < 0 || ny < 0 || nx >= int32_t(grid_size.x) || ny >= int32_t(grid_size.y)) continue;
+				uint32_t next = ny * grid_size.x + nx;
+				if (!open[next]) continue;
+				if (ox != 0 && oy != 0 && (!open[y * grid_size.x + nx] || !open[ny * grid_size.x + x])) continue;
+				float cost = search_cost[cell] + (ox != 0 && oy != 0 ? std::sqrt(2.0f) : 1.0f);
+				if (search_stamp[next] == search_count && search_cost[next] <= cost) continue;
+				search_stamp[next] = search_count;
+				search_cost[next] = cost;
+				search_parent[next] = cell;
+				search_heap.emplace_back(cost + heuristic(next), next);
+				std::push_heap(search_heap.begin(), search_heap.end(), heap_order);
+			}
+		}
+	}
+
+	if (!found) {
+		route.distance = std::numeric_limits< float >::infinity();
+		return route;
+	}
+
+	route.distance = search_cost[to] * cell_size;
+
+	//sound arrives from the direction of the last path cell the listener can still see:
+	search_path.clear();
+	for (uint32_t cell = to; cell != -1U; cell = search_parent[cell]) {
+		search_path.emplace_back(cell);
+	}
+	route.via = from;
+	for (auto cell = search_path.rbegin(); cell != search_path.rend(); ++cell) {
+		if (!visible(from, *cell)) break;
+		route.via = *cell;
+	}
+
+	return route;
+}
+
+void SoundPropagation::set_listener(glm::vec3 const &position) {
+	listener = position;
+	listener_cell = cell_at(position);
+}
+
+glm::vec3 SoundPropagation::apparent_position(glm::vec3 const &source) {
+	uint32_t source_cell = cell_at(source);
+	//outside the mapped geometry, sound travels in a straight line:
+	if (listener_cell == -1U || source_cell == -1U) return source;
+
+	Route const &r = route(listener_cell, source_cell);
+	if (r.visible) return source;
+
+	glm::vec3 to_source = source - listener;
+	if (r.distance == std::numeric_limits< float >::infinity()) {
+		return listener + to_source / blocked_occlusion;
+	}
+
+	//mixer attenuates by distance, so fold occlusion into the distance:
+	glm::vec2 to_via = cell_center(r.via) - glm::vec2(listener);
+	glm::vec3 dir;
+	if (glm::dot(to_via, to_via) > 1e-6f) {
+		dir = glm::normalize(glm::vec3(to_via, 0.0f));
+	} else if (glm::dot(to_source, to_source) > 1e-12f) {
+		dir = glm::normalize(to_source);
+	} else {
+		return source;
+	}
+	float distance = std::max(r.distance, glm::length(to_source)) / occlusion;
+	return listener + dir * distance;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+//"SoundPropagation" routes sound around walls instead of through them.
+// It builds a coarse grid over the floor plane (xy) from level geometry,
+// finds the shortest open path from listener to source, and reports an
+// "apparent position" for the source: in the direction the sound arrives from,
+// at the distance it travelled (pushed further away when heard around corners).
+// Feeding apparent positions to the mixer (e.g., via Scene::update_sound_emitters)
+// gives walls an effect without changing the mixer itself.
+
+struct SoundPropagation {
+	//build from a triangle soup (world space, three vertices per triangle):
+	// upward-facing triangles (floors) open cells, steep triangles (walls) close them again.
+	SoundPropagation(std::vector< glm::vec3 > const &triangles, float cell_size = 0.5f);
+
+	//build from a mesh in a ".pnc" file (as written by export-meshes.py), placed by 'to_world':
+	// note: will throw if the file fails to read or doesn't contain the mesh.
+	SoundPropagation(std::string const &filename, std::string const &mesh_name, glm::mat4x3 const &to_world, float cell_size = 0.5f);
+
+	//call whenever the listener moves (cheap unless the listener changes cells):
+	void set_listener(glm::vec3 const &position);
+
+	//where the mixer should place a sound at 'source' so it is heard around walls:
+	// (results are cached per (source cell, listener cell), so this is usually a lookup)
+	glm::vec3 apparent_position(glm::vec3 const &source);
+
+	//how much quieter sound heard around a corner is than the path length alone suggests:
+	float occlusion = 0.5f;
+	//...and sound with no open path at all:
+	float blocked_occlusion = 0.1f;
+
+	//bounding box of the geometry (e.g., for sizing reverb zones):
+	glm::vec3 geometry_min = glm::vec3(0.0f);
+	glm::vec3 geometry_max = glm::vec3(0.0f);
+
+	//------ internals ------
+
+	//grid over the floor plane:
+	glm::vec2 grid_min = glm::vec2(0.0f);
+	glm::uvec2 grid_size = glm::uvec2(0);
+	float cell_size = 0.5f;
+	std::vector< uint8_t > open; //1 if sound can travel through the cell
+
+	glm::vec3 listener = glm::vec3(0.0f);
+	uint32_t listener_cell = -1U;
+
+	//cached routes, keyed by (listener cell, source cell):
+	struct Route {
+		float distance = 0.0f; //length of shortest open path (world units), or infinity if there is none
+		uint32_t via = -1U; //furthest cell along the path that the listener's cell can see
+		bool visible = false; //can the listener's cell see the source's cell directly?
+	};
+	std::unordered_map< uint64_t, Route > routes;
+	Route const &route(uint32_t from, uint32_t to);
+
+	//helpers:
+	void build(std::vector< glm::vec3 > const &triangles);
+	uint32_t cell_at(glm::vec3 const &position) const; //nearby open cell, or -1U if none
+	glm::vec2 cell_center(uint32_t cell) const;
+	bool visible(uint32_t from, uint32_t to) const; //straight line between cell centers stays in open cells
+
+	//pooled A* search state (re-used between searches):
+	std::vector< float > search_cost;
+	std::vector< uint32_t > search_parent;
+	std::vector< uint32_t > search_stamp; //search that last touched a cell
+	uint32_t search_count = 0;
+	std::vector< std::pair< float, uint32_t > > search_heap;
+	std::vector< uint32_t > search_path;
+};
@@ -1,219 +1,475 @@
 
 #include "WalkMesh.hpp"
 #include "read_chunk.hpp"
+#include "Jobs.hpp"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp> //allows the use of 'vec3' and 'uvec2' as unordered_map keys
+
 #include <fstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
 
+WalkMesh::WalkMesh(std::vector<glm::vec3> const &vertices_, std::vector< glm::uvec3 > const &triangles_) {
+	for (auto const &tri : triangles_) {
+		if (tri.x >= vertices_.size() || tri.y >= vertices_.size() || tri.z >= vertices_.size()) {
+			throw std::runtime_error("WalkMesh triangle refers to a vertex that doesn't exist.");
+		}
+	}
 
-WalkMesh::WalkMesh(std::vector<glm::vec3> const &vertices_, std::vector< glm::uvec3 > const &triangles_)
-	: vertices(vertices_), triangles(triangles_) {
-	//this vertex struct will only have positions and normals
-	struct Vertex {
-		glm::vec3 position;
-		glm::vec3 normal;
-	};
-	//Make sure vertex is the size expected as declared in struct
-	static_assert(sizeof(Vertex) == 3*4+3*4, "Vertex is packed.");
-	std::vector< Vertex > rawData;
-	std::ifstream inputFile;
-	inputFile.open("meshtest.pn", std::ifstream::in);
-	//reading inputFile as a .pn
-	read_chunk(inputFile, "pn..", &rawData);
-	inputFile.close();
-	uint32_t len = rawData.size();
-	uint32_t loadMap = 0;
-	//loop through newly loaded rawData and extract normal and position info out of it
-	for (uint32_t i=0; i<len; i++) {
-		//fill in vertex position
-		glm::vec3 vertPos = rawData[i].position;
-		vertices.emplace_back(vertPos);
-		//also load each vertex's normals to walk on uneven ground
-		glm::vec3 vertNorm = rawData[i].normal;
-		vertex_normals.emplace_back(vertNorm);
-		loadMap++;
-		//load the map and triangle indices in all at once
-		if (loadMap == 3) {
-			uint32_t vert1Ind = i;
-			uint32_t vert2Ind = i-1;
-			uint32_t vert3Ind = i-2; //safe b/c won't run til at least 3 indices in vertex list
-			triangles.emplace_back(glm::uvec3(vert1Ind, vert2Ind, vert3Ind));
-			std::pair<glm::uvec2, uint32_t> pair1 (glm::uvec2(vert1Ind, vert2Ind), vert3Ind);
-			next_vertex.insert(pair1);
-			std::pair<glm::uvec2, uint32_t> pair2 (glm::uvec2(vert2Ind, vert3Ind), vert1Ind);
-			next_vertex.insert(pair2);
-			std::pair<glm::uvec2, uint32_t> pair3 (glm::uvec2(vert3Ind, vert1Ind), vert2Ind);
-			next_vertex.insert(pair3);
-			/*
-			glm::uvec2 vert1_2 = glm::uvec2(vert1Ind, vert2Ind);
-			glm::uvec2 vert2_3 = glm::uvec2(vert2Ind, vert3Ind);
-			glm::uvec2 vert3_1 = glm::uvec2(vert3Ind, vert1Ind);
-			next_vertex.insert(std::make_pair<glm::uvec2, uint32_t>(vert1_2, vert3Ind));
-			next_vertex.insert(std::make_pair<glm::uvec2, uint32_t>(vert2_3, vert1Ind));
-			next_vertex.insert(std::make_pair<glm::uvec2, uint32_t>(vert3_1, vert2Ind));
-			*/
-			loadMap = 0;
+	//weld vertices that share a position (meshes are usually exported as triangle soup), so shared edges share indices:
+	{
+		std::unordered_map< glm::vec3, uint32_t > welded;
+		std::vector< uint32_t > remap(vertices_.size());
+		for (uint32_t v = 0; v < vertices_.size(); ++v) {
+			auto ret = welded.insert(std::make_pair(vertices_[v], uint32_t(storage.vertices.size())));
+			if (ret.second) storage.vertices.emplace_back(vertices_[v]);
+			remap[v] = ret.first->second;
+		}
+		storage.triangles.reserve(triangles_.size());
+		for (auto const &tri : triangles_) {
+			storage.triangles.emplace_back(remap[tri.x], remap[tri.y], remap[tri.z]);
+		}
+	}
+
+	//triangle planes, and vertex normals as the (area-weighted) average of their triangles' normals:
+	storage.planes.reserve(storage.triangles.size());
+	storage.vertex_normals.assign(storage.vertices.size(), glm::vec3(0.0f));
+	for (auto const &tri : storage.triangles) {
+		glm::vec3 const &a = storage.vertices[tri.x];
+		glm::vec3 n = glm::cross(storage.vertices[tri.y] - a, storage.vertices[tri.z] - a);
+		for (uint32_t i = 0; i < 3; ++i) storage.vertex_normals[tri[i]] += n;
+		n = (n != glm::vec3(0.0f) ? glm::normalize(n) : glm::vec3(0.0f, 0.0f, 1.0f));
+		storage.planes.emplace_back(n, -glm::dot(n, a));
+	}
+	for (auto &n : storage.vertex_normals) {
+		n = (n != glm::vec3(0.0f) ? glm::normalize(n) : glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+
+	//world-to-barycentric transforms:
+	// with ab = b - a, ac = c - a, the weights of b and c for a point p solve the 2x2 system of dot(p - a, ab) and dot(p - a, ac),
+	// so each weight is a dot product of p with a fixed vector plus an offset:
+	storage.to_barycentric.reserve(storage.triangles.size());
+	for (auto const &tri : storage.triangles) {
+		glm::vec3 const &a = storage.vertices[tri.x];
+		glm::vec3 ab = storage.vertices[tri.y] - a;
+		glm::vec3 ac = storage.vertices[tri.z] - a;
+		float d00 = glm::dot(ab, ab);
+		float d01 = glm::dot(ab, ac);
+		float d11 = glm::dot(ac, ac);
+		float denom = d00 * d11 - d01 * d01;
+		glm::mat4x3 xf = glm::mat4x3(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f / 3.0f));
+		if (denom != 0.0f) { //(degenerate triangles map everything to their middle)
+			glm::vec3 row_v = (d11 * ab - d01 * ac) / denom;
+			glm::vec3 row_w = (d00 * ac - d01 * ab) / denom;
+			glm::vec3 row_u = -(row_v + row_w);
+			for (uint32_t i = 0; i < 3; ++i) {
+				xf[i] = glm::vec3(row_u[i], row_v[i], row_w[i]);
+			}
+			xf[3] = glm::vec3(1.0f - glm::dot(row_u, a), -glm::dot(row_v, a), -glm::dot(row_w, a));
 		}
+		storage.to_barycentric.emplace_back(xf);
 	}
+
+	//link each edge to its twin (the same edge, running the other way, in the triangle across it):
+	{
+		std::unordered_map< glm::uvec2, uint32_t > edges; //(from, to) -> half-edge
+		for (uint32_t t = 0; t < storage.triangles.size(); ++t) {
+			glm::uvec3 const &tri = storage.triangles[t];
+			for (uint32_t e = 0; e < 3; ++e) {
+				edges.insert(std::make_pair(glm::uvec2(tri[e], tri[(e+1)%3]), 3 * t + e));
+			}
+		}
+		storage.neighbors.assign(storage.triangles.size(), glm::uvec3(-1U));
+		for (uint32_t t = 0; t < storage.triangles.size(); ++t) {
+			glm::uvec3 const &tri = storage.triangles[t];
+			for (uint32_t e = 0; e < 3; ++e) {
+				glm::uvec2 edge = glm::uvec2(tri[e], tri[(e+1)%3]);
+				auto twin = edges.find(glm::uvec2(edge.y, edge.x));
+				//(only link pairs that agree, so edges shared by more than two triangles stay consistent)
+				if (twin != edges.end() && edges.find(edge)->second == 3 * t + e) {
+					storage.neighbors[t][e] = twin->second;
+				}
+			}
+		}
+	}
+
+	vertex_count = uint32_t(storage.vertices.size());
+	vertices = storage.vertices.data();
+	vertex_normals = storage.vertex_normals.data();
+	triangle_count = uint32_t(storage.triangles.size());
+	triangles = storage.triangles.data();
+	neighbors = storage.neighbors.data();
+	planes = storage.planes.data();
+	to_barycentric = storage.to_barycentric.data();
+
+	build_grid();
+	grid_first = storage.grid_first.data();
+	grid_triangles = storage.grid_triangles.data();
 }
 
-//using heron's formula
-float WalkMesh::triangleArea(glm::vec3 A, glm::vec3 B, glm::vec3 C) const {
-	float a = glm::distance(A, B);
-	float b = glm::distance(B, C);
-	float c = glm::distance(C, A);
-	float semiperim = a+b+c;
-	float area = glm::sqrt(semiperim*(semiperim-a)*(semiperim-b)*(semiperim-c));
-	return area;
+WalkMesh::WalkMesh(std::string const &filename) : mapped(new MappedFile(filename)) {
+	char const *at = mapped->data;
+	char const *end = mapped->data + mapped->size;
+	try {
+		vertex_count = map_chunk(at, end, "wmv0", &vertices);
+		if (map_chunk(at, end, "wmn0", &vertex_normals) != vertex_count) {
+			throw std::runtime_error("vertex normal count doesn't match vertex count");
+		}
+		triangle_count = map_chunk(at, end, "wmt0", &triangles);
+		if (map_chunk(at, end, "wma0", &neighbors) != triangle_count) {
+			throw std::runtime_error("neighbor count doesn't match triangle count");
+		}
+		if (map_chunk(at, end, "wmp0", &planes) != triangle_count) {
+			throw std::runtime_error("plane count doesn't match triangle count");
+		}
+		if (map_chunk(at, end, "wmb0", &to_barycentric) != triangle_count) {
+			throw std::runtime_error("barycentric transform count doesn't match triangle count");
+		}
+		GridHeader const *header = nullptr;
+		if (map_chunk(at, end, "wmg0", &header) != 1) {
+			throw std::runtime_error("expecting exactly one grid header");
+		}
+		grid = *header;
+		if (map_chunk(at, end, "wmc0", &grid_first) != grid.size.x * grid.size.y + 1) {
+			throw std::runtime_error("grid cell count doesn't match grid size");
+		}
+		uint32_t grid_entries = map_chunk(at, end, "wmi0", &grid_triangles);
+
+		//check indices, so walking can trust them:
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				if (triangles[t][i] >= vertex_count) throw std::runtime_error("triangle refers to a vertex that doesn't exist");
+				if (neighbors[t][i] != -1U && neighbors[t][i] >= 3 * triangle_count) throw std::runtime_error("neighbor refers to a triangle that doesn't exist");
+			}
+		}
+		for (uint32_t c = 0; c < grid.size.x * grid.size.y; ++c) {
+			if (grid_first[c] > grid_first[c + 1]) throw std::runtime_error("grid cells are out of order");
+		}
+		if (grid_first[grid.size.x * grid.size.y] != grid_entries) {
+			throw std::runtime_error("grid entry count doesn't match grid");
+		}
+		for (uint32_t i = 0; i < grid_entries; ++i) {
+			if (grid_triangles[i] >= triangle_count) throw std::runtime_error("grid refers to a triangle that doesn't exist");
+		}
+	} catch (std::runtime_error &e) {
+		throw std::runtime_error("Failed to load walk mesh '" + filename + "': " + e.what());
+	}
 }
 
-glm::vec3 WalkMesh::barycentric(glm::vec3 A, glm::vec3 B, glm::vec3 C, glm::vec3 pt) const {
-	float triArea = triangleArea(A, B, C); //total bestTriangle's area
-	float CAP = triangleArea(C, A, pt); //area of u's subtriangle
-	float ABP = triangleArea(B, A, pt); //area of v's subtriangle
-	float BCP = triangleArea(C, B, pt); //area of w's subtriangle
-	float u = CAP/triArea;
-	float v = ABP/triArea;
-	float w = BCP/triArea;
-	assert(u+v+w == 1.0f); //sanity check
-	assert(u>=0 and v>=0 and w>=0); //make sure inside triangle
-	glm::vec3 baryCoords = glm::vec3(u, v, w);
-	return baryCoords;
+void WalkMesh::save(std::string const &filename) const {
+	std::ofstream out(filename, std::ios::binary);
+	auto write_chunk = [&out](char const *magic, void const *data, size_t size) {
+		assert(size <= 0xffffffff);
+		uint32_t size32 = uint32_t(size);
+		out.write(magic, 4);
+		out.write(reinterpret_cast< char const * >(&size32), 4);
+		out.write(reinterpret_cast< char const * >(data), size);
+	};
+	write_chunk("wmv0", vertices, vertex_count * sizeof(glm::vec3));
+	write_chunk("wmn0", vertex_normals, vertex_count * sizeof(glm::vec3));
+	write_chunk("wmt0", triangles, triangle_count * sizeof(glm::uvec3));
+	write_chunk("wma0", neighbors, triangle_count * sizeof(glm::uvec3));
+	write_chunk("wmp0", planes, triangle_count * sizeof(glm::vec4));
+	write_chunk("wmb0", to_barycentric, triangle_count * sizeof(glm::mat4x3));
+	write_chunk("wmg0", &grid, sizeof(GridHeader));
+	write_chunk("wmc0", grid_first, (grid.size.x * grid.size.y + 1) * sizeof(uint32_t));
+	write_chunk("wmi0", grid_triangles, grid_first[grid.size.x * grid.size.y] * sizeof(uint32_t));
+	if (!out) {
+		throw std::runtime_error("Failed to write walk mesh '" + filename + "'.");
+	}
 }
 
-WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
-	WalkPoint closest;
-	glm::uvec3 bestTriangle;
-	glm::vec3 closestPt;
-	for (uint32_t t=0; t<triangles.size(); t++) {
-		//POINT IN TRIANGLE TEST
-		//for each triangle, find closest point on triangle to world_point
-		glm::uvec3 currTriangle = triangles[t]; //use this as an index into vertices
-		glm::vec3 currNormal = vertex_normals[t];
-		glm::vec3 a = vertices[currTriangle[0]]; //pick a random pt in plane (a triangle vertex)
-		glm::vec3 currPt = (world_point + a*glm::cross(currNormal,currNormal))/(glm::dot(currNormal,currNormal) + 1); //q
-		//?? BARYCENTRIC-IFY AND SEE IF IT IS IN TRIANGLE. IF NOT THEN FIND CLOSEST ON TRIANGLE EDGE
-		//new smallest distance!
-		if (glm::distance(currPt, world_point)<glm::distance(closestPt, world_point)) {
-			bestTriangle = currTriangle; //use this as an index into vertices
-			closestPt = currPt;
-		}
-	}
-	//if point is closest, closest.triangle gets the current triangle, closest.weights gets the barycentric coordinates
-	glm::vec3 barycent = barycentric(vertices[bestTriangle[0]], vertices[bestTriangle[1]], vertices[bestTriangle[2]], closestPt);
-	closest.triangle = bestTriangle;
-	closest.weights = barycent;
-	return closest;
+//closest point to 'pt' on triangle abc, as barycentric weights:
+// (from Ericson's "Real-Time Collision Detection", section 5.1.5)
+static glm::vec3 closest_weights(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, glm::vec3 const &pt) {
+	glm::vec3 ab = b - a, ac = c - a, ap = pt - a;
+	float d1 = glm::dot(ab, ap);
+	float d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return glm::vec3(1.0f, 0.0f, 0.0f); //vertex a
+
+	glm::vec3 bp = pt - b;
+	float d3 = glm::dot(ab, bp);
+	float d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return glm::vec3(0.0f, 1.0f, 0.0f); //vertex b
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) { //edge ab
+		float v = d1 / (d1 - d3);
+		return glm::vec3(1.0f - v, v, 0.0f);
+	}
+
+	glm::vec3 cp = pt - c;
+	float d5 = glm::dot(ab, cp);
+	float d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return glm::vec3(0.0f, 0.0f, 1.0f); //vertex c
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) { //edge ac
+		float w = d2 / (d2 - d6);
+		return glm::vec3(1.0f - w, 0.0f, w);
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) { //edge bc
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return glm::vec3(0.0f, 1.0f - w, w);
+	}
+
+	//inside the face:
+	float denom = 1.0f / (va + vb + vc);
+	float v = vb * denom;
+	float w = vc * denom;
+	return glm::vec3(1.0f - v - w, v, w);
 }
 
-void WalkMesh::walk(WalkPoint &wp, glm::vec3 const &step) const {
-	//wp comes in filled out.
-	//project step to barycentric coordinates to get weights_step want in terms of wp.triangle
-	glm::uvec3 startTri = wp.triangle;
-	glm::vec3 weights_step = barycentric(vertices[startTri[0]], vertices[startTri[1]], vertices[startTri[2]], step);
-
-	float t = 1.0f;
-	//keep updating walk 1 triangle at a time until no more time to walk
-	while (t>0) {
-		glm::uvec3 currTri = wp.triangle;
-		//stepping over edge (one of barycentric subtriangles is zero in area)
-		glm::vec3 crossEdge = wp.weights+t*weights_step; //has already been scaled by t.
-		if (crossEdge[0]<=0 or crossEdge[1]<=0 or crossEdge[2]<=0) {
-			//check in xyz coords divide each by weights_step to get which edge hit first (most negative)
-			float tX = (-wp.weights[0])/weights_step[0];
-			float tY = (-wp.weights[1])/weights_step[1];
-			float tZ = (-wp.weights[2])/weights_step[2];
-			float tMin1 = std::min(tX, tY);
-			float tMin = std::min(tMin1, tZ);
-			//figure out which two vertices it crosses and if it crosses a vertex reroute to edge
-			uint32_t vertex1; //(?? DRAW A PICTURE)
-			uint32_t vertex2;
-			if (tMin == tX) {
-				vertex1 = currTri[0];
-				vertex2 = currTri[1];
-			}
-			else if (tMin == tY) {
-				vertex1 = currTri[1];
-				vertex2 = currTri[2];
+void WalkMesh::build_grid() {
+	//(an empty mesh still gets a one-cell grid, so grid_first is never empty)
+	grid = GridHeader();
+	grid.size = glm::uvec2(1);
+	storage.grid_first.assign(2, 0);
+	storage.grid_triangles.clear();
+	if (triangle_count == 0) return;
+
+	glm::vec2 min = glm::vec2(std::numeric_limits< float >::infinity());
+	glm::vec2 max = -min;
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		min = glm::min(min, glm::vec2(vertices[v]));
+		max = glm::max(max, glm::vec2(vertices[v]));
+	}
+	//aim for a couple of triangles per cell (with a cap on the grid's size):
+	glm::vec2 extent = glm::max(max - min, glm::vec2(1e-3f));
+	grid.cell = std::sqrt(2.0f * extent.x * extent.y / float(triangle_count));
+	grid.cell = std::max(grid.cell, std::max(extent.x, extent.y) / 1024.0f);
+	grid.min = min;
+	grid.size = glm::uvec2(glm::max(glm::ceil(extent / grid.cell), glm::vec2(1.0f)));
+
+	//counting sort triangles into the cells their bounding boxes overlap:
+	auto cell_range = [this](uint32_t t, glm::uvec2 *lo, glm::uvec2 *hi) {
+		glm::uvec3 const &tri = triangles[t];
+		glm::vec2 a = glm::vec2(vertices[tri.x]), b = glm::vec2(vertices[tri.y]), c = glm::vec2(vertices[tri.z]);
+		glm::vec2 tmin = (glm::min(a, glm::min(b, c)) - grid.min) / grid.cell;
+		glm::vec2 tmax = (glm::max(a, glm::max(b, c)) - grid.min) / grid.cell;
+		*lo = glm::min(glm::uvec2(glm::max(tmin, glm::vec2(0.0f))), grid.size - glm::uvec2(1));
+		*hi = glm::min(glm::uvec2(glm::max(tmax, glm::vec2(0.0f))), grid.size - glm::uvec2(1));
+	};
+	std::vector< uint32_t > &grid_first = storage.grid_first;
+	std::vector< uint32_t > &grid_triangles = storage.grid_triangles;
+	grid_first.assign(grid.size.x * grid.size.y + 1, 0);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		glm::uvec2 lo, hi;
+		cell_range(t, &lo, &hi);
+		for (uint32_t y = lo.y; y <= hi.y; ++y) {
+			for (uint32_t x = lo.x; x <= hi.x; ++x) {
+				grid_first[y * grid.size.x + x + 1] += 1;
 			}
-			else { //tMin == tZ
-				vertex1 = currTri[2];
-				vertex2 = currTri[0];
+		}
+	}
+	for (uint32_t c = 0; c + 1 < grid_first.size(); ++c) {
+		grid_first[c + 1] += grid_first[c];
+	}
+	grid_triangles.resize(grid_first.back());
+	std::vector< uint32_t > fill(grid_first.begin(), grid_first.end() - 1);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		glm::uvec2 lo, hi;
+		cell_range(t, &lo, &hi);
+		for (uint32_t y = lo.y; y <= hi.y; ++y) {
+			for (uint32_t x = lo.x; x <= hi.x; ++x) {
+				grid_triangles[fill[y * grid.size.x + x]++] = t;
 			}
-			//wp.weights gets moved to triangle edge (barycentric calculation), and step gets reduced
-			wp.weights = barycentric(vertices[currTri[0]], vertices[currTri[1]], vertices[currTri[2]], wp.weights*tMin);
-			//if there is another triangle over the edge: (input vertices in opposite order)
-			if (next_vertex.find(glm::uvec2(vertex2, vertex1)) != next_vertex.end()) {
-				auto itr = next_vertex.find(glm::uvec2(vertex2, vertex1));
-				uint32_t newTriVertex = itr->second;
-				//wp.triangle gets updated to adjacent triangle (put in terms of barycentric for new triangle)
-				glm::vec3 oldNormal = vertex_normals[wp.triangle[0]];
-				for (uint32_t i=0; i<triangles.size(); i++) {
-					glm::uvec3 aTriangle = triangles[i];
-					bool x = false;
-					bool y = false;
-					bool z = false;
-					for (uint32_t j=0; j<3; j++) { //loop through subtriangle
-						if (vertices[aTriangle[0]]==vertices[vertex1] or 
-							vertices[aTriangle[0]]==vertices[vertex2] or
-							vertices[aTriangle[0]]==vertices[newTriVertex]) {
-							x = true;
-						}
-						else if (vertices[aTriangle[1]]==vertices[vertex1] or 
-							vertices[aTriangle[1]]==vertices[vertex2] or
-							vertices[aTriangle[1]]==vertices[newTriVertex]) {
-							y = true;
-						}
-						else {
-							z = true;
-						}
-					}
-					if (x and y and z) {
-						wp.triangle = aTriangle;
-						break;
+		}
+	}
+}
+
+WalkMesh::WalkPoint WalkMesh::start(glm::vec3 const &world_point) const {
+	assert(triangle_count > 0);
+	WalkPoint closest;
+	float closest_dis2 = std::numeric_limits< float >::infinity();
+
+	//search rings of cells outward from the point's cell until no unsearched cell can hold anything closer:
+	glm::vec2 at = (glm::vec2(world_point) - grid.min) / grid.cell;
+	glm::ivec2 center = glm::clamp(glm::ivec2(glm::floor(at)), glm::ivec2(0), glm::ivec2(grid.size) - glm::ivec2(1));
+	int32_t max_ring = int32_t(std::max(grid.size.x, grid.size.y));
+	for (int32_t ring = 0; ring <= max_ring; ++ring) {
+		glm::ivec2 lo = center - glm::ivec2(ring);
+		glm::ivec2 hi = center + glm::ivec2(ring);
+		for (int32_t y = lo.y; y <= hi.y; ++y) {
+			if (y < 0 || y >= int32_t(grid.size.y)) continue;
+			//(only the ring's border is new)
+			int32_t step = (y == lo.y || y == hi.y ? 1 : hi.x - lo.x);
+			for (int32_t x = lo.x; x <= hi.x; x += std::max(step, 1)) {
+				if (x < 0 || x >= int32_t(grid.size.x)) continue;
+				uint32_t cell = uint32_t(y) * grid.size.x + uint32_t(x);
+				for (uint32_t i = grid_first[cell]; i < grid_first[cell + 1]; ++i) {
+					uint32_t t = grid_triangles[i];
+					glm::uvec3 const &tri = triangles[t];
+					glm::vec3 const &a = vertices[tri.x];
+					glm::vec3 const &b = vertices[tri.y];
+					glm::vec3 const &c = vertices[tri.z];
+					glm::vec3 weights = closest_weights(a, b, c, world_point);
+					glm::vec3 pt = weights.x * a + weights.y * b + weights.z * c;
+					float dis2 = glm::dot(pt - world_point, pt - world_point);
+					if (dis2 < closest_dis2) {
+						closest_dis2 = dis2;
+						closest.triangle = t;
+						closest.weights = weights;
 					}
 				}
-				//step gets rotated over the edge (use rotation matrix from two triangles normals)
-				//algorithm for rotation matrices from:
-				//https://math.stackexchange.com/questions/180418/calculate-rotation-matrix-to-align-vector-a-to-vector-b-in-3d
-				glm::vec3 newNormal = vertex_normals[wp.triangle[0]];
-				glm::vec3 v = glm::cross(oldNormal, newNormal);
-				//float s = std::sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]); //angle sine is norm
-				float c = glm::dot(oldNormal, newNormal); //angle cosine
-				glm::mat3 vx = glm::mat3(0, -v[2], v[1], v[2], 0, -v[0], -v[1], v[0], 0);
-				glm::mat3 I = glm::mat3(1, 0, 0, 0, 1, 0, 0, 0, 1);
-				glm::mat3 rotate = I+vx+(1/(1+c));
-				weights_step = rotate*weights_step;
 			}
-			//else if there is no other triangle over the edge:
-			else {
-				//wp.triangle stays the same.
-				//step gets updated to slide along the edge
-				//??
-				wp.weights = wp.weights+weights_step[0];
+		}
+		//anything outside the searched square is at least this far away (in xy, so also in 3D):
+		float outside = std::numeric_limits< float >::infinity();
+		if (lo.x > 0) outside = std::min(outside, at.x - float(lo.x));
+		if (lo.y > 0) outside = std::min(outside, at.y - float(lo.y));
+		if (hi.x + 1 < int32_t(grid.size.x)) outside = std::min(outside, float(hi.x + 1) - at.x);
+		if (hi.y + 1 < int32_t(grid.size.y)) outside = std::min(outside, float(hi.y + 1) - at.y);
+		if (outside == std::numeric_limits< float >::infinity()) break; //searched the whole grid
+		outside = std::max(outside, 0.0f) * grid.cell;
+		if (closest_dis2 <= outside * outside) break;
+	}
+	return closest;
+}
+
+void WalkMesh::walk(WalkPoint &wp, glm::vec3 const &step) const {
+	//(bounded, so degenerate corners can't trap the loop)
+	march(wp, step, true, 32);
+}
+
+bool WalkMesh::raycast(WalkPoint &wp, glm::vec3 const &step) const {
+	//(a ray can cross the whole mesh, but not much more than once)
+	return march(wp, step, false, triangle_count + 32);
+}
+
+bool WalkMesh::visible(WalkPoint const &from, WalkPoint const &to) const {
+	if (from.triangle == to.triangle) return true; //(triangles are convex)
+	WalkPoint at = from;
+	return raycast(at, world_point(to) - world_point(from));
+}
+
+bool WalkMesh::march(WalkPoint &wp, glm::vec3 const &step, bool slide, uint32_t max_crossings) const {
+	assert(wp.triangle < triangle_count);
+	glm::vec3 remaining = step;
+	//edge the point is on (by its opposite vertex), which the step shouldn't cross back over:
+	uint32_t on_edge = -1U;
+	for (uint32_t crossings = 0; crossings < max_crossings; ++crossings) {
+		//where the step would end, in this triangle's barycentric coordinates:
+		glm::vec3 end = wp.weights + to_barycentric[wp.triangle] * glm::vec4(remaining, 0.0f);
+
+		//common case -- the step stays inside the triangle:
+		if (end.x >= 0.0f && end.y >= 0.0f && end.z >= 0.0f) {
+			wp.weights = end;
+			return true;
+		}
+		if (on_edge != -1U) end[on_edge] = std::max(end[on_edge], 0.0f);
+
+		//find the first edge the step crosses (weight i reaching zero means crossing the edge opposite vertex i):
+		float t = 1.0f;
+		uint32_t hit = -1U;
+		for (uint32_t i = 0; i < 3; ++i) {
+			if (end[i] < 0.0f && i != on_edge) {
+				float ti = wp.weights[i] / (wp.weights[i] - end[i]);
+				if (ti < t) {
+					t = ti;
+					hit = i;
+				}
 			}
-			//case on tMin positive / negative if zero should be on next triangle 
-			//?? CHEK
-			t = t+tMin;
-			std::cout<<"t is "<<t<<std::endl;
 		}
-		else {
-			//wp.weights gets moved by weights_step, nothing else needs to be done.
-			wp.weights += weights_step;
-			t = 0.0f;
+		if (hit == -1U) {
+			wp.weights = end;
+			return true;
 		}
-	}
 
-/*
-	if (t >= 1.0f) { //if a triangle edge is not crossed
-		//wp.weights gets moved by weights_step, nothing else needs to be done.
+		//move to the edge:
+		wp.weights += t * (end - wp.weights);
+		wp.weights[hit] = 0.0f;
+		wp.weights /= (wp.weights.x + wp.weights.y + wp.weights.z);
+		remaining *= (1.0f - t);
+
+		glm::uvec3 const &tri = triangles[wp.triangle];
+		uint32_t edge = (hit + 1) % 3; //edge runs from tri[edge] to tri[(edge+1)%3]
+		glm::vec3 const &from = vertices[tri[edge]];
+		glm::vec3 const &to = vertices[tri[(edge+1)%3]];
+		glm::vec3 along = glm::normalize(to - from);
+		uint32_t twin = neighbors[wp.triangle][edge];
+		if (twin == -1U && !slide) {
+			//no triangle over the edge, so the ray stops here:
+			return false;
+		} else if (twin == -1U) {
+			//no triangle over the edge, so slide along it:
+			remaining = along * glm::dot(along, remaining);
+			on_edge = hit;
+		} else {
+			//the twin runs the other way along the edge, so its weights are these two, swapped:
+			uint32_t next = twin / 3;
+			uint32_t next_edge = twin % 3;
+			glm::vec3 weights = glm::vec3(0.0f);
+			weights[next_edge] = wp.weights[(edge+1)%3];
+			weights[(next_edge+1)%3] = wp.weights[edge];
+
+			//fold the step over the edge into the next triangle's plane:
+			glm::vec3 old_normal = glm::vec3(planes[wp.triangle]);
+			glm::vec3 new_normal = glm::vec3(planes[next]);
+			remaining = along * glm::dot(along, remaining)
+			          + glm::cross(new_normal, along) * glm::dot(glm::cross(old_normal, along), remaining);
+
+			wp.triangle = next;
+			wp.weights = weights;
+			on_edge = (next_edge + 2) % 3;
+		}
+		if (remaining == glm::vec3(0.0f)) return true;
 	}
-	else { //if a triangle edge is crossed
-		//wp.weights gets moved to triangle edge, and step gets reduced
-		//if there is another triangle over the edge:
-			//wp.triangle gets updated to adjacent triangle
-			//step gets rotated over the edge
-		//else if there is no other triangle over the edge:
-			//wp.triangle stays the same.
-			//step gets updated to slide along the edge
+	return false;
+}
+
+//walk points [begin,end) of a batch:
+static void walk_range(WalkMesh const &mesh, uint32_t begin, uint32_t end, uint32_t *triangles, glm::vec3 *weights, glm::vec3 const *steps) {
+	constexpr const uint32_t Block = WalkMesh::WalkBlock;
+	uint32_t crossing[Block]; //points in the block that leave their triangles
+	for (uint32_t first = begin; first < end; first += Block) {
+		uint32_t count = std::min(Block, end - first);
+		uint32_t *block_triangles = triangles + first;
+		glm::vec3 *block_weights = weights + first;
+		glm::vec3 const *block_steps = steps + first;
+
+		//step every point as if it stays in its triangle, keeping those that do:
+		// (no branches on the result except the store, so this runs at the speed of the transform loads)
+		uint32_t crossing_count = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			glm::vec3 end = block_weights[i] + mesh.to_barycentric[block_triangles[i]] * glm::vec4(block_steps[i], 0.0f);
+			bool inside = (end.x >= 0.0f) & (end.y >= 0.0f) & (end.z >= 0.0f);
+			if (inside) block_weights[i] = end;
+			crossing[crossing_count] = i;
+			crossing_count += (inside ? 0 : 1);
+		}
+
+		//walk the rest (which cross edges) the slow way:
+		for (uint32_t c = 0; c < crossing_count; ++c) {
+			uint32_t i = crossing[c];
+			WalkMesh::WalkPoint wp;
+			wp.triangle = block_triangles[i];
+			wp.weights = block_weights[i];
+			mesh.walk(wp, block_steps[i]);
+			block_triangles[i] = wp.triangle;
+			block_weights[i] = wp.weights;
+		}
 	}
-*/
+}
+
+void WalkMesh::walk(uint32_t count, uint32_t *triangles_, glm::vec3 *weights, glm::vec3 const *steps) const {
+	Jobs::parallel_for(count, WalkPerJob, [&](uint32_t begin, uint32_t end) {
+		walk_range(*this, begin, end, triangles_, weights, steps);
+	});
+}
+
+void WalkMesh::raycast(uint32_t count, uint32_t const *triangles_, glm::vec3 const *weights, glm::vec3 const *steps, bool *clear) const {
+	Jobs::parallel_for(count, WalkPerJob, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; ++i) {
+			WalkPoint wp;
+			wp.triangle = triangles_[i];
+			wp.weights = weights[i];
+			clear[i] = raycast(wp, steps[i]);
+		}
+	});
 }
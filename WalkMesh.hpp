@@ -1,62 +1,145 @@
 #pragma once
 
-#include <vector>
-#include <unordered_map>
+#include "mapped_file.hpp"
+
+#include <glm/glm.hpp>
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <vector>
+#include <string>
+#include <memory>
+#include <limits>
 
 struct WalkMesh {
+	//Construct new WalkMesh from triangles (welding vertices that share a position), building neighbors, planes, and grid:
+	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::uvec3 > const &triangles_);
+
+	//Load a cooked walk mesh (as written by save()); the file is mapped, not parsed, so even large meshes are ready at once:
+	// note: will throw if the file fails to read or isn't a walk mesh.
+	WalkMesh(std::string const &filename);
+
+	//Write everything above to a file of chunks (see read_chunk.hpp):
+	//  "wmv0": vertices (vec3)          "wmn0": vertex normals (vec3)
+	//  "wmt0": triangles (uvec3)        "wma0": neighbors (uvec3)       "wmp0": planes (vec4)
+	//  "wmb0": to_barycentric (mat4x3)
+	//  "wmg0": GridHeader               "wmc0": grid_first (uint32)     "wmi0": grid_triangles (uint32)
+	// (walkmesh_cook.cpp cooks these from exported meshes)
+	void save(std::string const &filename) const;
+
+	WalkMesh(WalkMesh const &) = delete;
+	WalkMesh &operator=(WalkMesh const &) = delete;
+
 	//Walk mesh will keep track of triangles, vertices:
-	std::vector< glm::vec3 > vertices;
-	std::vector< glm::uvec3 > triangles; //(CCW) counterclockwise-oriented
+	// (arrays point into 'mapped' for a loaded mesh, or into 'storage' for a constructed one)
+	uint32_t vertex_count = 0;
+	glm::vec3 const *vertices = nullptr;
+	uint32_t triangle_count = 0;
+	glm::uvec3 const *triangles = nullptr; //(CCW) counterclockwise-oriented
 
 	//vertex normals for interpolated "up" direction:
-	std::vector< glm::vec3 > vertex_normals;
+	glm::vec3 const *vertex_normals = nullptr;
 
-	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle, and is useful for checking what's over an edge from a given point:
-	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
+	//Triangle adjacency, half-edge style: edge e of triangle t runs from triangles[t][e] to triangles[t][(e+1)%3],
+	// and neighbors[t][e] is that edge's twin in the triangle across it, as (3 * t' + e'), or -1U on the boundary.
+	// (so crossing an edge is one load, and the twin's edge index says how weights carry over)
+	glm::uvec3 const *neighbors = nullptr;
 
-	//Construct new WalkMesh and build next_vertex structure:
-	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::uvec3 > const &triangles_);
+	//triangle planes: xyz is the (unit) normal, and dot(xyz, pt) + w == 0 for points on the plane:
+	glm::vec4 const *planes = nullptr;
+
+	//world-to-barycentric transforms: to_barycentric[t] * vec4(pt, 1) is the (signed) weights of pt projected onto triangle t,
+	// and to_barycentric[t] * vec4(step, 0) is how a step changes weights (its columns sum to zero, so weights keep summing to one):
+	glm::mat4x3 const *to_barycentric = nullptr;
 
 	struct WalkPoint {
-		glm::uvec3 triangle = glm::uvec3(-1U); //indices of current triangle
-		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point
+		uint32_t triangle = -1U; //index of current triangle
+		glm::vec3 weights = glm::vec3(std::numeric_limits< float >::quiet_NaN()); //barycentric coordinates for current point (in triangles[triangle] order)
 	};
 
-	//CHANGED
-	float triangleArea(glm::vec3 A, glm::vec3 B, glm::vec3 C) const;
-	glm::vec3 barycentric(glm::vec3 A, glm::vec3 B, glm::vec3 C, glm::vec3 pt) const;
+	//barycentric coordinates of 'pt' (projected onto the triangle's plane); negative outside the triangle:
+	glm::vec3 barycentric(uint32_t triangle, glm::vec3 const &pt) const {
+		return to_barycentric[triangle] * glm::vec4(pt, 1.0f);
+	}
 
 	//used to initialize walking -- finds the closest point on the walk mesh:
-	// (should only need to call this at the start of a level)
+	// (uses the grid below, so it is cheap enough to re-snap agents every frame)
 	WalkPoint start(glm::vec3 const &world_point) const;
 
+	//uniform grid over the floor plane (xy) for start(): each cell lists the triangles whose bounding boxes overlap it,
+	// cell c's triangles are grid_triangles[grid_first[c]] up to grid_triangles[grid_first[c+1]]:
+	struct GridHeader {
+		glm::vec2 min = glm::vec2(0.0f);
+		glm::uvec2 size = glm::uvec2(0);
+		float cell = 1.0f; //cell size (world units)
+		uint32_t padding = 0;
+	};
+	static_assert(sizeof(GridHeader) == 24, "GridHeader is packed");
+	GridHeader grid;
+	uint32_t const *grid_first = nullptr;
+	uint32_t const *grid_triangles = nullptr;
+
 	//used to update walk point:
 	void walk(WalkPoint &wp, glm::vec3 const &step) const;
 
+	//update many walk points at once, stored as arrays (point i is triangles[i], weights[i] and moves by steps[i]):
+	// points that stay in their triangle are stepped in blocks by a branch-free loop (one transform each);
+	// only points that cross edges go through walk() above. Large batches are split into jobs (see Jobs.hpp).
+	void walk(uint32_t count, uint32_t *triangles, glm::vec3 *weights, glm::vec3 const *steps) const;
+	static constexpr const uint32_t WalkBlock = 64; //points per block
+	static constexpr const uint32_t WalkPerJob = 16384; //points per job (a whole number of blocks; fewer aren't worth handing to another thread)
+
+	//raycast along the mesh: moves 'wp' along 'step' like walk(), but stops at the first boundary edge instead of sliding:
+	// returns true if the whole step was taken, i.e., nothing blocks the way along the floor.
+	bool raycast(WalkPoint &wp, glm::vec3 const &step) const;
+
+	//can 'to' be seen from 'from' along the floor? (on a flat floor, whether the straight line between them stays on the mesh;
+	// over slopes, the line follows the surface like a walk would)
+	bool visible(WalkPoint const &from, WalkPoint const &to) const;
+
+	//raycast many points at once (arrays as in the batched walk above): clear[i] is set to whether ray i got through.
+	void raycast(uint32_t count, uint32_t const *triangles, glm::vec3 const *weights, glm::vec3 const *steps, bool *clear) const;
+
 	//used to read back results of walking:
 	glm::vec3 world_point(WalkPoint const &wp) const {
-		return wp.weights.x * vertices[wp.triangle.x]
-		     + wp.weights.y * vertices[wp.triangle.y]
-		     + wp.weights.z * vertices[wp.triangle.z];
+		glm::uvec3 const &tri = triangles[wp.triangle];
+		return wp.weights.x * vertices[tri.x]
+		     + wp.weights.y * vertices[tri.y]
+		     + wp.weights.z * vertices[tri.z];
 	}
 
 	glm::vec3 world_normal(WalkPoint const &wp) const {
-		//TODO: could interpolate vertex_normals instead of computing the triangle normal:
-		return glm::normalize(glm::cross(
-			vertices[wp.triangle.y] - vertices[wp.triangle.x],
-			vertices[wp.triangle.z] - vertices[wp.triangle.x]
-		));
+		//TODO: could interpolate vertex_normals instead of using the triangle normal:
+		return glm::vec3(planes[wp.triangle]);
 	}
 
+	//------ internals ------
+
+	//data for a constructed mesh:
+	struct {
+		std::vector< glm::vec3 > vertices;
+		std::vector< glm::vec3 > vertex_normals;
+		std::vector< glm::uvec3 > triangles;
+		std::vector< glm::uvec3 > neighbors;
+		std::vector< glm::vec4 > planes;
+		std::vector< glm::mat4x3 > to_barycentric;
+		std::vector< uint32_t > grid_first;
+		std::vector< uint32_t > grid_triangles;
+	} storage;
+	void build_grid(); //(called by the constructor)
+
+	//shared by walk() and raycast(): moves 'wp' along 'step', across at most max_crossings edges, sliding along the boundary (or stopping at it);
+	// returns true if the whole step was taken (without sliding, that means without reaching the boundary).
+	bool march(WalkPoint &wp, glm::vec3 const &step, bool slide, uint32_t max_crossings) const;
+
+	//...or the file a loaded mesh is mapped from:
+	std::unique_ptr< MappedFile > mapped;
 };
 
 /*
 // The intent is that game code will work something like this:
 
-Load< WalkMesh > walk_mesh;
+Load< WalkMesh > walk_mesh(LoadTagDefault, [](){
+	return new WalkMesh(data_path("walkmesh.wm")); //(cooked by walkmesh_cook)
+});
 
 Game {
 	WalkPoint walk_point;
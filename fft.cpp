@@ -0,0 +1,96 @@
+#include "fft.hpp"
+
+#include <stdexcept>
+#include <cassert>
+#include <utility>
+#include <string>
+#include <cmath>
+
+FFTPlan::FFTPlan(uint32_t size_) : size(size_) {
+	if (size == 0 || (size & (size - 1)) != 0) {
+		throw std::runtime_error("FFT size " + std::to_string(size) + " is not a power of two.");
+	}
+	uint32_t bits = 0;
+	while ((1U << bits) < size) ++bits;
+
+	bit_reverse.resize(size);
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t r = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (i & (1U << b)) r |= 1U << (bits - 1 - b);
+		}
+		bit_reverse[i] = r;
+	}
+
+	twiddles.resize(size / 2);
+	for (uint32_t k = 0; k < size / 2; ++k) {
+		double angle = -2.0 * 3.14159265358979323846 * k / double(size);
+		twiddles[k] = std::complex< float >(float(std::cos(angle)), float(std::sin(angle)));
+	}
+}
+
+void FFTPlan::forward(std::complex< float > *data) const {
+	transform(data, size, false);
+}
+
+void FFTPlan::inverse(std::complex< float > *data) const {
+	transform(data, size, true);
+}
+
+void FFTPlan::forward_real(float const *in, std::complex< float > *out) const {
+	assert(size >= 4);
+	//pack even/odd values as real/imaginary parts, and do a half-size transform:
+	uint32_t half = size / 2;
+	for (uint32_t n = 0; n < half; ++n) {
+		out[n] = std::complex< float >(in[2 * n], in[2 * n + 1]);
+	}
+	transform(out, half, false);
+
+	//then untangle the even (E) and odd (O) spectra, working inward from both ends:
+	// X[k] = E[k] + twiddle[k] O[k], and X[half - k] uses conjugates of the same E and O
+	std::complex< float > z0 = out[0];
+	out[0] = std::complex< float >(z0.real() + z0.imag(), 0.0f);
+	out[half] = std::complex< float >(z0.real() - z0.imag(), 0.0f);
+	for (uint32_t k = 1; k <= half / 2; ++k) {
+		uint32_t j = half - k;
+		std::complex< float > zk = out[k], zj = out[j];
+		//E = (zk + conj(zj)) / 2, O = (zk - conj(zj)) * (-i / 2):
+		float even_r = 0.5f * (zk.real() + zj.real()), even_i = 0.5f * (zk.imag() - zj.imag());
+		float odd_r = 0.5f * (zk.imag() + zj.imag()), odd_i = -0.5f * (zk.real() - zj.real());
+		//twiddle[j] = -conj(twiddle[k]), so both results share one product:
+		std::complex< float > const &w = twiddles[k];
+		float pr = w.real() * odd_r - w.imag() * odd_i;
+		float pi = w.real() * odd_i + w.imag() * odd_r;
+		out[k] = std::complex< float >(even_r + pr, even_i + pi);
+		out[j] = std::complex< float >(even_r - pr, pi - even_i);
+	}
+}
+
+void FFTPlan::transform(std::complex< float > *data, uint32_t count, bool inverse) const {
+	//(a transform of a smaller count uses every (size / count)th table entry)
+	uint32_t scale = size / count;
+	uint32_t shift = 0;
+	while ((1U << shift) < scale) ++shift;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t r = bit_reverse[i] >> shift;
+		if (i < r) std::swap(data[i], data[r]);
+	}
+	//iterative Cooley-Tukey butterflies (complex multiplies are written out, since
+	// std::complex's operator* checks for infinities and is much slower):
+	float sign = (inverse ? -1.0f : 1.0f);
+	for (uint32_t half = 1; half < count; half *= 2) {
+		uint32_t stride = scale * count / (2 * half);
+		for (uint32_t begin = 0; begin < count; begin += 2 * half) {
+			for (uint32_t k = 0; k < half; ++k) {
+				std::complex< float > const &w = twiddles[k * stride];
+				float wr = w.real(), wi = sign * w.imag();
+				std::complex< float > &a = data[begin + k];
+				std::complex< float > &b = data[begin + k + half];
+				float br = b.real() * wr - b.imag() * wi;
+				float bi = b.real() * wi + b.imag() * wr;
+				b = std::complex< float >(a.real() - br, a.imag() - bi);
+				a = std::complex< float >(a.real() + br, a.imag() + bi);
+			}
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+#include <cstdint>
+
+//FFTPlan holds the tables for in-place radix-2 FFTs of one (power-of-two) size,
+// so any number of transforms of that size can share them:
+//   FFTPlan plan(128);
+//   plan.forward(data); //data is 128 std::complex< float >'s
+struct FFTPlan {
+	FFTPlan(uint32_t size); //will throw if size is not a power of two
+
+	//transform in place; neither direction scales, so forward-then-inverse multiplies by size:
+	void forward(std::complex< float > *data) const;
+	void inverse(std::complex< float > *data) const;
+	//transform 'size' real values into the first size / 2 + 1 bins of their spectrum
+	// (the rest are conjugates); costs about half as much as forward():
+	void forward_real(float const *in, std::complex< float > *out) const;
+
+	uint32_t size;
+
+	//internals:
+	std::vector< uint32_t > bit_reverse; //bit_reverse[i] is i with its (log2(size)) bits reversed
+	std::vector< std::complex< float > > twiddles; //exp(-2 pi i k / size) for k < size / 2
+	void transform(std::complex< float > *data, uint32_t count, bool inverse) const; //count divides size
+};
@@ -10,6 +10,12 @@
 //The 'Sound' header has functions for managing sound:
 #include "Sound.hpp"
 
+//...and 'realtime_check' for checking that the audio thread doesn't allocate or block:
+#include "realtime_check.hpp"
+
+//Jobs is the thread pool everything that wants more cores shares:
+#include "Jobs.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -28,14 +34,66 @@
 #include <fstream>
 #include <memory>
 #include <algorithm>
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <thread>
+
+//parse a whole number (e.g., the '4' of '--mix-threads=4'); returns false if 'value' isn't one:
+static bool parse_count(std::string const &value, uint32_t *count) {
+	if (value.empty() || value[0] < '0' || value[0] > '9') return false;
+	errno = 0;
+	char *end = nullptr;
+	unsigned long parsed = std::strtoul(value.c_str(), &end, 10);
+	if (*end != '\0' || errno == ERANGE || parsed > 0xffffffffUL) return false;
+	*count = uint32_t(parsed);
+	return true;
+}
 
 int main(int argc, char **argv) {
 	struct {
 		//TODO: this is where you set the title and size of your game window
 		std::string title = "TODO: Game Title";
 		glm::uvec2 size = glm::uvec2(640, 400);
+		//smaller audio blocks make sounds react faster (run with --low-latency):
+		uint32_t audio_samples = Sound::MixSamples;
+		//binaural rendering for headphones (run with --hrtf, or --hrtf=responses.hrtf to load measured responses):
+		bool hrtf = false;
+		std::string hrtf_file = "";
+		//report allocation and blocking in the audio thread (run with --realtime-check; needs a REALTIME_CHECK build, see Jamfile):
+		bool realtime_check = false;
+		//threads to share mixing with, for scenes with many sounds (run with --mix-threads=N):
+		uint32_t mix_threads = 0;
+		//worker threads for the job pool (run with --jobs=N, at most one per core besides the main thread; that many by default):
+		uint32_t jobs = -1U;
 	} config;
 
+	//(thread counts are capped at one per core besides the thread that waits on them)
+	uint32_t const cores = std::max(1U, std::thread::hardware_concurrency());
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		uint32_t count = 0;
+		if (arg == "--low-latency") {
+			config.audio_samples = Sound::LowLatencyMixSamples;
+		} else if (arg == "--hrtf") {
+			config.hrtf = true;
+		} else if (arg.substr(0, 7) == "--hrtf=") {
+			config.hrtf = true;
+			config.hrtf_file = arg.substr(7);
+		} else if (arg == "--realtime-check") {
+			config.realtime_check = true;
+		} else if (arg.substr(0, 14) == "--mix-threads=" && parse_count(arg.substr(14), &count)) {
+			//(mixing workers spin while the mixer runs, and so does the audio thread waiting for them, so one core is left for it)
+			config.mix_threads = std::min(count, cores - 1);
+		} else if (arg.substr(0, 7) == "--jobs=" && parse_count(arg.substr(7), &count)) {
+			//(workers beyond one per core besides this thread would just take turns)
+			config.jobs = std::min(count, cores - 1);
+		} else {
+			std::cerr << "Ignoring unknown argument '" << arg << "'." << std::endl;
+		}
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -97,7 +155,18 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound output --------------
-	Sound::init();
+	if (config.realtime_check) RealtimeCheck::enable();
+	Sound::init(config.audio_samples);
+	if (config.hrtf) {
+		Sound::enable_hrtf(config.hrtf_file);
+	}
+	if (config.mix_threads) {
+		Sound::set_mix_threads(config.mix_threads);
+	}
+
+	//------------ start job pool --------------
+	//(before loading, so loaders can use it too; the mixer keeps its own realtime threads)
+	Jobs::init(config.jobs);
 
 	//------------ load assets --------------
 
@@ -158,10 +227,27 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
+			//advance the simulation in fixed steps, carrying leftover time to the next frame:
+			static float accumulator = 0.0f;
+			accumulator += elapsed;
+			uint32_t steps = 0;
+			while (accumulator >= Mode::FixedStep && steps < Mode::MaxFixedSteps) {
+				Mode::current->fixed_update(Mode::FixedStep);
+				accumulator -= Mode::FixedStep;
+				++steps;
+				if (!Mode::current) break;
+			}
+			if (!Mode::current) break;
+			//(drop whatever the steps couldn't catch up on)
+			accumulator = std::fmod(accumulator, Mode::FixedStep);
+
+			Mode::current->fixed_alpha = accumulator / Mode::FixedStep;
 			Mode::current->update(elapsed);
 			if (!Mode::current) break;
 		}
 
+		if (config.realtime_check) RealtimeCheck::report(std::cerr);
+
 		{ //(3) call the current mode's "draw" function to produce output:
 			//clear the depth+color buffers and set some default state:
 			glClearColor(0.5, 0.5, 0.5, 0.0);
@@ -180,6 +266,9 @@ int main(int argc, char **argv) {
 
 	//------------  teardown ------------
 
+	Jobs::shutdown();
+	Sound::shutdown();
+
 	SDL_GL_DeleteContext(context);
 	context = 0;
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+//MappedFile maps an entire file into memory (read-only).
+// Useful for caches and assets that are stored on disk in exactly the layout
+// used at runtime, since no copying or parsing is needed to use them.
+//   MappedFile file(data_path("thing.cache"));
+//   Header const *header = reinterpret_cast< Header const * >(file.data);
+struct MappedFile {
+	//map a file; will throw if the file can't be opened or mapped:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *data = nullptr; //start of file contents
+	size_t size = 0; //size of file contents, in bytes
+
+	//internals:
+	#if defined(_WIN32)
+	void *file = nullptr;
+	void *mapping = nullptr;
+	#else
+	int fd = -1;
+	#endif
+};
@@ -4,6 +4,7 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *_to) {
@@ -33,3 +34,39 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Failed to read chunk data.");
 	}
 }
+
+//map_chunk is read_chunk for data already in memory (e.g., a MappedFile):
+// instead of copying, it points *_to at the chunk's contents, returns the number of elements,
+// and advances 'from' past the chunk.
+template< typename T >
+uint32_t map_chunk(char const *&from, char const *end, std::string const &magic, T const **_to) {
+	assert(_to);
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (size_t(end - from) < sizeof(ChunkHeader)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	ChunkHeader header = *reinterpret_cast< ChunkHeader const * >(from);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - from) - sizeof(ChunkHeader) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+	if (reinterpret_cast< uintptr_t >(from + sizeof(ChunkHeader)) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is misaligned.");
+	}
+
+	*_to = reinterpret_cast< T const * >(from + sizeof(ChunkHeader));
+	from += sizeof(ChunkHeader) + header.size;
+	return header.size / sizeof(T);
+}
@@ -0,0 +1,227 @@
+#include "realtime_check.hpp"
+
+#if defined(REALTIME_CHECK)
+//(the checker replaces the allocator and mutex locking for the whole process, so it is only built when asked for)
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#include <unistd.h>
+#define REALTIME_CHECK_EXECINFO
+#endif
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+
+namespace {
+
+std::atomic< bool > checking(false);
+thread_local bool in_realtime = false; //inside a Scope
+thread_local bool in_hook = false; //inside a hook (so nested allocations aren't counted twice)
+
+std::atomic< uint32_t > count(0);
+
+//violations are written by real-time threads into a ring and read by report():
+constexpr const uint32_t RingSize = 64;
+constexpr const int MaxFrames = 24;
+struct Violation {
+	std::atomic< bool > ready{false}; //written, but not yet reported
+	char const *what = nullptr;
+	int frames = 0;
+	void *frame[MaxFrames];
+};
+Violation ring[RingSize];
+std::atomic< uint32_t > ring_written(0);
+uint32_t ring_read = 0;
+
+void record(char const *what) {
+	count.fetch_add(1, std::memory_order_relaxed);
+	Violation &v = ring[ring_written.fetch_add(1) % RingSize];
+	if (v.ready.load(std::memory_order_acquire)) return; //report() is behind; just count this one
+	v.what = what;
+	#if defined(REALTIME_CHECK_EXECINFO)
+	v.frames = backtrace(v.frame, MaxFrames);
+	#else
+	v.frames = 0;
+	#endif
+	v.ready.store(true, std::memory_order_release);
+}
+
+//hooks call this to check and record a violation; returns with in_hook set, and the
+// hook should clear it (via HookGuard) so anything the hooked call does internally is ignored:
+struct HookGuard {
+	HookGuard(char const *what) : outer(in_hook) {
+		if (outer) return;
+		in_hook = true;
+		if (in_realtime && checking.load(std::memory_order_relaxed)) record(what);
+	}
+	~HookGuard() {
+		if (!outer) in_hook = false;
+	}
+	bool outer;
+};
+
+} //(anonymous namespace)
+
+namespace RealtimeCheck {
+
+void enable() {
+	#if defined(REALTIME_CHECK_EXECINFO)
+	//the first backtrace() loads libgcc (which allocates), so do that now rather than in a real-time thread:
+	void *frames[2];
+	backtrace(frames, 2);
+	#endif
+	checking = true;
+	std::cout << "Real-time checking enabled." << std::endl;
+}
+
+bool enabled() {
+	return checking;
+}
+
+Scope::Scope() : was(in_realtime) {
+	in_realtime = true;
+}
+
+Scope::~Scope() {
+	in_realtime = was;
+}
+
+void blocking(char const *what) {
+	HookGuard guard(what);
+}
+
+uint32_t violations() {
+	return count;
+}
+
+void report(std::ostream &out) {
+	while (ring[ring_read % RingSize].ready.load(std::memory_order_acquire)) {
+		Violation &v = ring[ring_read % RingSize];
+		out << "REAL-TIME VIOLATION: '" << v.what << "' in a real-time thread (" << count << " so far):" << std::endl;
+		#if defined(REALTIME_CHECK_EXECINFO)
+		if (v.frames > 0) {
+			out.flush();
+			//(skip the frames inside the checker itself)
+			int skip = (v.frames > 3 ? 3 : 0);
+			backtrace_symbols_fd(v.frame + skip, v.frames - skip, STDERR_FILENO);
+		}
+		#endif
+		v.ready.store(false, std::memory_order_release);
+		ring_read += 1;
+	}
+}
+
+} //namespace RealtimeCheck
+
+//------ hooks ------
+
+#if defined(__GLIBC__)
+//glibc exports its allocator under these names, so malloc and friends can be wrapped:
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+	HookGuard guard("malloc");
+	return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size) {
+	HookGuard guard("calloc");
+	return __libc_calloc(count, size);
+}
+void *realloc(void *ptr, size_t size) {
+	HookGuard guard("realloc");
+	return __libc_realloc(ptr, size);
+}
+void free(void *ptr) {
+	if (ptr) {
+		HookGuard guard("free");
+		__libc_free(ptr);
+	}
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	typedef int (*LockFn)(pthread_mutex_t *);
+	static LockFn real = reinterpret_cast< LockFn >(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+	HookGuard guard("pthread_mutex_lock");
+	return real(mutex);
+}
+} //extern "C"
+#endif
+
+void *operator new(size_t size) {
+	HookGuard guard("operator new");
+	void *ret = std::malloc(size ? size : 1);
+	if (!ret) throw std::bad_alloc();
+	return ret;
+}
+void *operator new[](size_t size) {
+	HookGuard guard("operator new[]");
+	void *ret = std::malloc(size ? size : 1);
+	if (!ret) throw std::bad_alloc();
+	return ret;
+}
+void *operator new(size_t size, std::nothrow_t const &) noexcept {
+	HookGuard guard("operator new");
+	return std::malloc(size ? size : 1);
+}
+void *operator new[](size_t size, std::nothrow_t const &) noexcept {
+	HookGuard guard("operator new[]");
+	return std::malloc(size ? size : 1);
+}
+void operator delete(void *ptr) noexcept {
+	if (!ptr) return;
+	HookGuard guard("operator delete");
+	std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept {
+	if (!ptr) return;
+	HookGuard guard("operator delete[]");
+	std::free(ptr);
+}
+void operator delete(void *ptr, std::nothrow_t const &) noexcept {
+	operator delete(ptr);
+}
+void operator delete[](void *ptr, std::nothrow_t const &) noexcept {
+	operator delete[](ptr);
+}
+
+#else //!defined(REALTIME_CHECK)
+//built without the hooks: nothing is replaced, checking can't be enabled, and scopes do nothing
+
+namespace RealtimeCheck {
+
+void enable() {
+	std::cerr << "WARNING: built without REALTIME_CHECK (build with 'jam -sREALTIME_CHECK=1'), so real-time checking is not available." << std::endl;
+}
+
+bool enabled() {
+	return false;
+}
+
+Scope::Scope() : was(false) {
+}
+
+Scope::~Scope() {
+}
+
+void blocking(char const *) {
+}
+
+uint32_t violations() {
+	return 0;
+}
+
+void report(std::ostream &) {
+}
+
+} //namespace RealtimeCheck
+
+#endif //defined(REALTIME_CHECK)
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+
+//RealtimeCheck catches code that could make audio glitch: while checking is enabled,
+// allocating, freeing, or blocking on a thread inside a RealtimeCheck::Scope is recorded
+// as a violation, along with a backtrace. (Sound's mixer runs in a Scope.)
+//
+//Allocation is caught by hooking operator new/delete everywhere, and malloc/free on Linux;
+// locking is caught by hooking pthread_mutex_lock on Linux, and anything else that may
+// block can mark itself by calling RealtimeCheck::blocking().
+//
+//The hooks replace the allocator and locking for the whole process, so they are only built
+// with REALTIME_CHECK defined (jam -sREALTIME_CHECK=1); otherwise enable() just warns and Scope does nothing.
+//
+//   RealtimeCheck::enable(); //at startup (e.g., main.cpp's --realtime-check)
+//   ...
+//   RealtimeCheck::report(std::cerr); //every so often, from the main thread
+namespace RealtimeCheck {
+
+//start checking (call from the main thread, before real-time threads start):
+void enable();
+bool enabled();
+
+//marks the current thread as real-time while alive:
+struct Scope {
+	Scope();
+	~Scope();
+	bool was; //(scopes nest)
+};
+
+//call from functions that may block; records a violation if called inside a Scope:
+void blocking(char const *what);
+
+//total violations recorded so far:
+uint32_t violations();
+
+//print violations (with backtraces) recorded since the last report:
+// (call from one, non-real-time thread)
+void report(std::ostream &out);
+
+} //namespace RealtimeCheck
@@ -0,0 +1,95 @@
+//sound_bench mixes a bunch of moving voices without an audio device and reports mixer performance.
+// usage: sound_bench [voices=64] [blocks=2000] [block_samples=1024] [reverb_zones=2] [hrtf=0] [multirate=1]
+// (to listen to mixer output without a device, use Sound::init_headless("out.wav") instead)
+
+#include "Sound.hpp"
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t voices = 64;
+	uint32_t blocks = 2000;
+	if (argc > 1) voices = uint32_t(std::stoul(argv[1]));
+	if (argc > 2) blocks = uint32_t(std::stoul(argv[2]));
+	uint32_t block_samples = Sound::MixSamples;
+	if (argc > 3) block_samples = uint32_t(std::stoul(argv[3]));
+	uint32_t reverb_zones = 2;
+	if (argc > 4) reverb_zones = uint32_t(std::stoul(argv[4]));
+	//voices started with HRTF enabled are convolved (with the built-in responses) instead of panned:
+	if (argc > 5 && std::stoul(argv[5]) != 0) Sound::enable_hrtf();
+	//quiet voices are mixed at reduced rates unless this is turned off:
+	if (argc > 6) Sound::set_multirate(std::stoul(argv[6]) != 0);
+	//mixing can be shared with worker threads:
+	if (argc > 7) Sound::set_mix_threads(uint32_t(std::stoul(argv[7])));
+
+	std::mt19937 mt(0x15466);
+	auto random = [&mt](float lo, float hi) {
+		return std::uniform_real_distribution< float >(lo, hi)(mt);
+	};
+	auto random_position = [&]() {
+		return glm::vec3(random(-20.0f, 20.0f), random(-20.0f, 20.0f), random(0.0f, 3.0f));
+	};
+
+	//a second of a sine sweep, so voices aren't all reading the same memory:
+	std::vector< float > tone(Sound::AudioRate);
+	for (uint32_t i = 0; i < tone.size(); ++i) {
+		float t = i / float(Sound::AudioRate);
+		tone[i] = 0.25f * std::sin(2.0f * 3.1415926f * (220.0f + 220.0f * t) * t);
+	}
+	Sound::Sample sample(tone);
+
+	//zones split the area voices move around in, so voices send to different reverbs (or none):
+	for (uint32_t z = 0; z < reverb_zones; ++z) {
+		float x = -20.0f + 40.0f * z / float(reverb_zones);
+		Sound::add_reverb_zone(glm::vec3(x, -20.0f, 0.0f), glm::vec3(x + 20.0f / reverb_zones, 20.0f, 3.0f));
+	}
+
+	std::vector< std::shared_ptr< Sound::PlayingSample > > playing;
+	for (uint32_t v = 0; v < voices; ++v) {
+		playing.emplace_back(sample.play(random_position(), random(0.2f, 1.0f), Sound::Loop));
+		playing.back()->i = uint32_t(mt() % sample.size);
+	}
+
+	std::vector< float > block(block_samples * 2);
+
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::duration total = Clock::duration::zero();
+	Clock::duration worst = Clock::duration::zero();
+	for (uint32_t b = 0; b < blocks; ++b) {
+		//every so often, move voices (with ramps, so the mixer has interpolation to do):
+		if (b % 8 == 0) {
+			for (auto &p : playing) {
+				p->set_position(random_position(), random(0.0f, 0.2f));
+				p->set_volume(random(0.2f, 1.0f), random(0.0f, 0.2f));
+			}
+			Sound::listener.set_position(random_position(), 0.1f);
+			Sound::listener.set_right(glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), 0.0f), 0.1f);
+		}
+
+		auto before = Clock::now();
+		Sound::mix(block.data(), block_samples);
+		auto after = Clock::now();
+		total += after - before;
+		worst = std::max(worst, after - before);
+	}
+
+	double ns_per_block = std::chrono::duration< double, std::nano >(total).count() / blocks;
+	double worst_ns = std::chrono::duration< double, std::nano >(worst).count();
+	double block_ns = 1e9 * block_samples / double(Sound::AudioRate);
+
+	std::cout << voices << " voices, " << blocks << " blocks of " << block_samples << " frames:\n";
+	std::cout << "  " << ns_per_block << " ns per block (worst " << worst_ns << " ns)\n";
+	std::cout << "  " << ns_per_block / std::max(1U, voices) << " ns per voice per block\n";
+	std::cout << "  " << block_ns / ns_per_block << "x real-time headroom (worst block " << block_ns / worst_ns << "x)" << std::endl;
+
+	Sound::shutdown();
+
+	return 0;
+}
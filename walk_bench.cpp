@@ -0,0 +1,195 @@
+//walk_bench builds a floor with walls on it and checks (and times) the walk mesh helpers that have no other test.
+// usage: walk_bench [size=64] [moves=2000] [agents=200]
+//  FlowField: the target wanders around the floor; after every move the repaired field is compared with a full rebuild.
+//  Crowd: agents start on a circle (on an open floor) and walk to the opposite side, all meeting in the middle;
+//   reports how close any two came (they should stay about two radii apart) and the cost of an update per agent.
+// Exits with status 1 if a check fails.
+
+#include "WalkMesh.hpp"
+#include "FlowField.hpp"
+#include "Crowd.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+//a size x size floor of unit squares, optionally with walls (missing squares) that have gaps in them, so ways around change as things move:
+static WalkMesh *make_floor(uint32_t size, bool walls) {
+	auto wall = [walls](uint32_t x, uint32_t y) {
+		return walls && ((x % 8 == 4 && y % 8 != 2) || (y % 16 == 12 && x % 8 != 6 && x % 8 != 4));
+	};
+	std::vector< glm::vec3 > vertices;
+	std::vector< glm::uvec3 > triangles;
+	for (uint32_t y = 0; y < size; ++y) {
+		for (uint32_t x = 0; x < size; ++x) {
+			if (wall(x, y)) continue;
+			uint32_t base = uint32_t(vertices.size());
+			vertices.emplace_back(float(x), float(y), 0.0f);
+			vertices.emplace_back(float(x + 1), float(y), 0.0f);
+			vertices.emplace_back(float(x + 1), float(y + 1), 0.0f);
+			vertices.emplace_back(float(x), float(y + 1), 0.0f);
+			triangles.emplace_back(base, base + 1, base + 2);
+			triangles.emplace_back(base, base + 2, base + 3);
+		}
+	}
+	return new WalkMesh(vertices, triangles); //(welds the shared corners)
+}
+
+int main(int argc, char **argv) {
+	uint32_t size = 64;
+	uint32_t moves = 2000;
+	if (argc > 1) size = std::max(8U, uint32_t(std::stoul(argv[1])));
+	if (argc > 2) moves = uint32_t(std::stoul(argv[2]));
+	uint32_t agents = 200;
+	if (argc > 3) agents = std::max(2U, uint32_t(std::stoul(argv[3])));
+
+	std::unique_ptr< WalkMesh > mesh(make_floor(size, true));
+	WalkMesh const &walk_mesh = *mesh;
+	std::cout << "floor of " << size << "x" << size << " squares: " << walk_mesh.triangle_count << " triangles\n";
+
+	std::mt19937 mt(0x15466);
+	auto random = [&mt](float lo, float hi) {
+		return std::uniform_real_distribution< float >(lo, hi)(mt);
+	};
+
+	typedef std::chrono::high_resolution_clock Clock;
+	bool failed = false;
+
+	{ //FlowField: repair must agree with a rebuild
+		FlowField field(walk_mesh), fresh(walk_mesh);
+		WalkMesh::WalkPoint target = walk_mesh.start(glm::vec3(0.5f, 0.5f, 0.0f));
+		field.set_target(target);
+		glm::vec3 heading = glm::vec3(0.0f);
+
+		Clock::duration repair_time = Clock::duration::zero();
+		Clock::duration rebuild_time = Clock::duration::zero();
+		uint64_t repair_touched = 0;
+		uint32_t changed = 0;
+		float worst = 0.0f;
+		for (uint32_t m = 0; m < moves && !failed; ++m) {
+			if (m % 40 == 0) heading = glm::vec3(random(-1.0f, 1.0f), random(-1.0f, 1.0f), 0.0f);
+			uint32_t before = target.triangle;
+			walk_mesh.walk(target, 0.3f * heading);
+			if (target.triangle == before) continue;
+			++changed;
+
+			auto t0 = Clock::now();
+			field.set_target(target);
+			auto t1 = Clock::now();
+			fresh.target = target;
+			fresh.rebuild();
+			auto t2 = Clock::now();
+			repair_time += t1 - t0;
+			rebuild_time += t2 - t1;
+			repair_touched += field.last_touched;
+
+			for (uint32_t t = 0; t < walk_mesh.triangle_count; ++t) {
+				float repaired = field.distance(t);
+				float rebuilt = fresh.distance(t);
+				if (std::isinf(repaired) != std::isinf(rebuilt)) {
+					std::cerr << "FlowField: triangle " << t << " reachable after repair but not rebuild (or the reverse), move " << m << std::endl;
+					failed = true;
+					break;
+				}
+				if (std::isinf(rebuilt)) continue;
+				float error = std::abs(repaired - rebuilt);
+				worst = std::max(worst, error);
+				if (error > 1e-3f * std::max(1.0f, rebuilt)) {
+					std::cerr << "FlowField: triangle " << t << " is " << repaired << " from the target after repair, but " << rebuilt << " after rebuild, move " << m << std::endl;
+					failed = true;
+					break;
+				}
+				//'next' must be a step along a shortest way:
+				uint32_t n = field.next[t];
+				if (n == -1U ? t != target.triangle : std::abs(field.distance(n) + glm::length(field.centers[t] - field.centers[n]) - repaired) > 1e-3f * std::max(1.0f, rebuilt)) {
+					std::cerr << "FlowField: triangle " << t << " has a bad next (" << int32_t(n) << "), move " << m << std::endl;
+					failed = true;
+					break;
+				}
+			}
+		}
+
+		double repair_us = std::chrono::duration< double, std::micro >(repair_time).count() / std::max(1U, changed);
+		double rebuild_us = std::chrono::duration< double, std::micro >(rebuild_time).count() / std::max(1U, changed);
+		std::cout << "FlowField, " << changed << " target moves (" << field.repairs << " repairs, " << field.rebuilds << " rebuilds):\n";
+		std::cout << "  worst difference from rebuild " << worst << "\n";
+		std::cout << "  " << double(repair_touched) / std::max(1U, changed) << " of " << walk_mesh.triangle_count << " triangles touched per repair\n";
+		std::cout << "  " << repair_us << " us per repair vs " << rebuild_us << " us per rebuild" << std::endl;
+	}
+
+	{ //Crowd: agents crossing a circle shouldn't walk through each other
+		constexpr const float Radius = 0.3f;
+		constexpr const float Speed = 2.0f;
+		constexpr const float Tick = 1.0f / 60.0f;
+		glm::vec2 const Veer = glm::vec2(std::cos(0.1f), std::sin(0.1f)); //(rotation by 0.1 radians, clockwise)
+		//(circle has room for the agents side by side, plus a margin around it)
+		float circle = std::max(8.0f, agents * 3.0f * Radius / (2.0f * 3.1415926f));
+		uint32_t open_size = uint32_t(std::ceil(2.0f * circle)) + 8;
+		std::unique_ptr< WalkMesh > open(make_floor(open_size, false));
+		glm::vec2 center = glm::vec2(0.5f * open_size);
+
+		Crowd crowd(*open);
+		std::vector< glm::vec2 > goals;
+		for (uint32_t a = 0; a < agents; ++a) {
+			float angle = 2.0f * 3.1415926f * a / float(agents);
+			glm::vec2 at = center + circle * glm::vec2(std::cos(angle), std::sin(angle));
+			crowd.add_agent(open->start(glm::vec3(at, 0.0f)), Radius, Speed);
+			goals.emplace_back(center - (at - center));
+		}
+
+		//(long enough to cross the circle several times over, for the detours and the crush in the middle)
+		uint32_t ticks = uint32_t(8.0f * 2.0f * circle / Speed / Tick);
+		Clock::duration update_time = Clock::duration::zero();
+		float closest = std::numeric_limits< float >::infinity();
+		uint32_t tick = 0;
+		uint32_t arrived = 0;
+		for (; tick < ticks && arrived < agents; ++tick) {
+			arrived = 0;
+			for (uint32_t a = 0; a < agents; ++a) {
+				glm::vec2 to = goals[a] - glm::vec2(crowd.positions[a]);
+				float length = glm::length(to);
+				if (length < 0.1f) ++arrived;
+				glm::vec2 preferred = (length > Speed * Tick ? to * (Speed / length) : to / Tick);
+				//(everyone veers a little to the right, or a perfectly symmetric ring of agents can stall in the middle)
+				crowd.preferred[a] = glm::vec2(Veer.x * preferred.x + Veer.y * preferred.y, Veer.x * preferred.y - Veer.y * preferred.x);
+			}
+			auto before = Clock::now();
+			crowd.update(Tick);
+			update_time += Clock::now() - before;
+			for (uint32_t a = 0; a < agents; ++a) {
+				for (uint32_t b = a + 1; b < agents; ++b) {
+					closest = std::min(closest, glm::length(glm::vec2(crowd.positions[a] - crowd.positions[b])));
+				}
+			}
+		}
+
+		double update_us = std::chrono::duration< double, std::micro >(update_time).count() / std::max(1U, tick);
+		std::cout << "Crowd, " << agents << " agents crossing a circle of radius " << circle << ":\n";
+		std::cout << "  " << arrived << " arrived after " << tick * Tick << " seconds\n";
+		std::cout << "  closest two agents came " << closest << " apart (radii sum to " << 2.0f * Radius << ")\n";
+		std::cout << "  " << update_us << " us per update, " << 1000.0 * update_us / agents << " ns per agent" << std::endl;
+		//(ORCA only promises no collisions up to its time step, so allow a little overlap)
+		if (closest < 0.9f * 2.0f * Radius) {
+			std::cerr << "Crowd: agents came " << closest << " apart, well inside each other's radii" << std::endl;
+			failed = true;
+		}
+		if (arrived < agents) {
+			std::cerr << "Crowd: only " << arrived << " of " << agents << " agents arrived" << std::endl;
+			failed = true;
+		}
+	}
+
+	if (failed) {
+		std::cerr << "FAILED" << std::endl;
+		return 1;
+	}
+	return 0;
+}
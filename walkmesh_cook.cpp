@@ -0,0 +1,116 @@
+//walkmesh_cook turns a mesh exported from blender into a ".wm" walk mesh, so the game can load
+// welded vertices, neighbor links, planes, and the start() grid without rebuilding them:
+// usage: walkmesh_cook <in.pnc> <mesh name> <out.wm> [x y z offset [scale]]
+//        walkmesh_cook <in.pn> - <out.wm> [x y z offset [scale]]
+// (every vertex is scaled, then offset, e.g., to cook a mesh in the place the game uses it)
+
+#include "WalkMesh.hpp"
+#include "read_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//read the triangle soup of one mesh from a ".pnc" (by name) or a ".pn" (which only holds one mesh):
+static std::vector< glm::vec3 > load_positions(std::string const &filename, std::string const &mesh_name) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+
+	std::vector< glm::vec3 > positions;
+	if (filename.size() >= 3 && filename.substr(filename.size()-3) == ".pn") {
+		struct Vertex {
+			glm::vec3 Position;
+			glm::vec3 Normal;
+		};
+		static_assert(sizeof(Vertex) == 3*4+3*4, "Vertex is packed.");
+		std::vector< Vertex > vertices;
+		read_chunk(file, "pn..", &vertices);
+		for (auto const &v : vertices) {
+			positions.emplace_back(v.Position);
+		}
+		return positions;
+	} else if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".pnc") {
+		//same layout as MeshBuffer's ".pnc" files:
+		struct Vertex {
+			glm::vec3 Position;
+			glm::vec3 Normal;
+			glm::u8vec4 Color;
+		};
+		static_assert(sizeof(Vertex) == 3*4+3*4+4*1, "Vertex is packed.");
+		std::vector< Vertex > vertices;
+		read_chunk(file, "pnc.", &vertices);
+
+		std::vector< char > strings;
+		read_chunk(file, "str0", &strings);
+
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+		std::vector< IndexEntry > index;
+		read_chunk(file, "idx0", &index);
+
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			if (std::string(&strings[0] + entry.name_begin, &strings[0] + entry.name_end) != mesh_name) continue;
+			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+				positions.emplace_back(vertices[v].Position);
+			}
+			return positions;
+		}
+		throw std::runtime_error("Mesh '" + mesh_name + "' not found in '" + filename + "'.");
+	} else {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc != 4 && argc != 7 && argc != 8) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnc> <mesh name> <out.wm> [x y z offset [scale]]\n\t" << argv[0] << " <in.pn> - <out.wm> [x y z offset [scale]]" << std::endl;
+		return 1;
+	}
+	glm::vec3 offset = glm::vec3(0.0f);
+	if (argc >= 7) {
+		offset = glm::vec3(std::stof(argv[4]), std::stof(argv[5]), std::stof(argv[6]));
+	}
+	float scale = 1.0f;
+	if (argc == 8) {
+		scale = std::stof(argv[7]);
+	}
+
+	try {
+		std::vector< glm::vec3 > positions = load_positions(argv[1], argv[2]);
+		if (positions.size() % 3 != 0) {
+			throw std::runtime_error("Expecting three vertices per triangle.");
+		}
+		std::vector< glm::uvec3 > triangles;
+		triangles.reserve(positions.size() / 3);
+		for (uint32_t i = 0; i + 2 < positions.size(); i += 3) {
+			triangles.emplace_back(i, i + 1, i + 2);
+		}
+		for (auto &p : positions) {
+			p = p * scale + offset;
+		}
+
+		WalkMesh walk_mesh(positions, triangles);
+		walk_mesh.save(argv[3]);
+		std::cout << "Wrote '" << argv[3] << "': " << walk_mesh.vertex_count << " vertices, " << walk_mesh.triangle_count << " triangles, "
+			<< walk_mesh.grid.size.x << "x" << walk_mesh.grid.size.y << " grid cells." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}